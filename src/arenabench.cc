@@ -0,0 +1,71 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "tree/rbtree.h"
+#include "tree/avltree.h"
+
+/**
+ * Build-query-discard batches: every round inserts n random keys,
+ * runs n lookups and clears the container. Times are the sum over
+ * all rounds.
+ */
+
+using seconds = std::chrono::duration<double>;
+
+template <class Tree>
+static void lookup(Tree& tree, const std::vector<int>& keys, long& found) {
+  for (int key : keys)
+    found += tree.lower_bound(key)->m_data == key;
+}
+
+template <class T, class Alloc>
+static void lookup(avltree<T, Alloc>& tree, const std::vector<int>& keys,
+                   long& found) {
+  for (int key : keys)
+    found += tree.contains(key);
+}
+
+template <class Tree>
+static void bench(const char* name, const std::vector<int>& keys, int rounds) {
+  seconds build(0), query(0), clear(0);
+  long found = 0;
+  for (int r = 0; r < rounds; r++) {
+    Tree tree;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int key : keys)
+      tree.insert(key);
+    auto t1 = std::chrono::steady_clock::now();
+    lookup(tree, keys, found);
+    auto t2 = std::chrono::steady_clock::now();
+    tree.clear();
+    auto t3 = std::chrono::steady_clock::now();
+    build += t1 - t0;
+    query += t2 - t1;
+    clear += t3 - t2;
+  }
+  printf("%-26s %10.3f %10.3f %10.4f %10.3f %10ld\n", name, build.count(),
+         query.count(), clear.count(), (build + query + clear).count(), found);
+}
+
+int main(int argc, const char* argv[]) {
+  size_t n = argc > 1 ? atol(argv[1]) : 1000000;
+  int rounds = argc > 2 ? atoi(argv[2]) : 5;
+  std::mt19937 rng(42);
+  std::vector<int> keys(n);
+  for (auto&& x : keys)
+    x = rng();
+
+  printf("\033[32m\033[1m%d rounds of %zu inserts, lookups, clear\033[0m\n",
+         rounds, n);
+  printf("\033[34mcontainer                   build (s)  query (s)"
+         "  clear (s)  total (s)      found\033[0m\n");
+  bench<rbtree<int, std::allocator<int>>>("rbtree   std::allocator", keys, rounds);
+  bench<rbtree<int, tiny_allocator<int>>>("rbtree   tiny_allocator", keys, rounds);
+  bench<rbtree<int, arena_allocator<int>>>("rbtree   arena_allocator", keys, rounds);
+  bench<avltree<int, std::allocator<int>>>("avltree  std::allocator", keys, rounds);
+  bench<avltree<int, tiny_allocator<int>>>("avltree  tiny_allocator", keys, rounds);
+  bench<avltree<int, arena_allocator<int>>>("avltree  arena_allocator", keys, rounds);
+  return 0;
+}
@@ -0,0 +1,72 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "tree/rbtree.h"
+#include "tree/avltree.h"
+
+/**
+ * avltree against rbtree on mixes of lookups, inserts and erases over
+ * a tree prefilled with n random keys from a 2n key space. An AVL tree
+ * is the lower of the two, which should pay off as reads dominate.
+ *
+ * usage: avlbench [keys, default 1000000] [ops, default 4000000]
+ */
+
+using seconds = std::chrono::duration<double>;
+using clock_type = std::chrono::steady_clock;
+
+static bool lookup(const rbtree<int>& tree, int key)
+{ return tree.contains(key); }
+
+static bool lookup(const avltree<int>& tree, int key)
+{ return tree.contains(key); }
+
+static void insert(rbtree<int>& tree, int key)
+{ tree.insert_unique(key); }
+
+static void insert(avltree<int>& tree, int key)
+{ tree.insert(key); }
+
+template <class Tree>
+static void bench(const char* name, int reads, const std::vector<int>& keys,
+                  const std::vector<int>& ops) {
+  Tree tree;
+  for (int key : keys)
+    insert(tree, key);
+  std::mt19937 rng(7);
+  long found = 0;
+  auto t0 = clock_type::now();
+  for (int key : ops) {
+    unsigned r = rng() % 100;
+    if (r < (unsigned)reads)
+      found += lookup(tree, key);
+    else if (r % 2)
+      insert(tree, key);
+    else
+      tree.erase(key);
+  }
+  auto t1 = clock_type::now();
+  printf("%-10s %5d%% %10.1f %10ld %10zu\n", name, reads,
+         seconds(t1 - t0).count() * 1e9 / ops.size(), found, tree.size());
+}
+
+int main(int argc, const char* argv[]) {
+  size_t n = argc > 1 ? atol(argv[1]) : 1000000;
+  size_t m = argc > 2 ? atol(argv[2]) : 4000000;
+  std::mt19937 rng(42);
+  std::vector<int> keys(n), ops(m);
+  for (auto&& x : keys)
+    x = rng() % (2 * n);
+  for (auto&& x : ops)
+    x = rng() % (2 * n);
+
+  printf("\033[32m\033[1m%zu prefilled keys, %zu operations\033[0m\n", n, m);
+  printf("\033[34mcontainer  reads    ns / op      found       size\033[0m\n");
+  for (int reads : {50, 90, 99, 100}) {
+    bench<rbtree<int>>("rbtree", reads, keys, ops);
+    bench<avltree<int>>("avltree", reads, keys, ops);
+  }
+  return 0;
+}
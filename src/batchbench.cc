@@ -0,0 +1,55 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "tree/rbtree.h"
+
+/**
+ * rbtree::lower_bound_batch against a loop of lower_bound calls over
+ * the same random probes, in million lookups per second.
+ *
+ * usage: batchbench [tree size, default 4000000] [probes, default 4000000]
+ */
+
+using seconds = std::chrono::duration<double>;
+using clock_type = std::chrono::steady_clock;
+using tree_type = rbtree<int>;
+using node_type = rbnode<int>;
+
+int main(int argc, const char* argv[]) {
+  size_t n = argc > 1 ? atol(argv[1]) : 4000000;
+  size_t m = argc > 2 ? atol(argv[2]) : 4000000;
+  std::mt19937 rng(42);
+  tree_type tree;
+  for (size_t i = 0; i < n; i++)
+    tree.insert_unique((int)rng());
+  std::vector<int> probes(m);
+  for (auto&& x : probes)
+    x = rng();
+  std::vector<node_type*> out(m);
+
+  printf("\033[32m\033[1m%zu keys, %zu random probes\033[0m\n",
+         tree.size(), m);
+  printf("\033[34mmethod                time (s)  Mlookup/s   checksum\033[0m\n");
+
+  auto t0 = clock_type::now();
+  for (size_t i = 0; i < m; i++)
+    out[i] = tree.lower_bound(probes[i]);
+  auto t1 = clock_type::now();
+  long sum = 0;
+  for (node_type* x : out)
+    sum += x == tree.end().node() ? 0 : x->m_data;
+  printf("%-20s %9.3f %10.2f %10ld\n", "lower_bound loop",
+         seconds(t1 - t0).count(), m / seconds(t1 - t0).count() / 1e6, sum);
+
+  t0 = clock_type::now();
+  tree.lower_bound_batch(probes.data(), m, out.data());
+  t1 = clock_type::now();
+  sum = 0;
+  for (node_type* x : out)
+    sum += x == tree.end().node() ? 0 : x->m_data;
+  printf("%-20s %9.3f %10.2f %10ld\n", "lower_bound_batch",
+         seconds(t1 - t0).count(), m / seconds(t1 - t0).count() / 1e6, sum);
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <set>
+#include <vector>
+#include "tree/rbtree.h"
+#include "tree/avltree.h"
+#include "tree/btree.h"
+
+/**
+ * btree_set against set (rbtree), avltree and std::set at growing
+ * sizes: n random inserts, n lookups (half of them hits) and n / 2
+ * erases, in ns per operation.
+ *
+ * usage: btreebench [max exponent, default 6 (10^3 .. 10^6 keys)]
+ */
+
+using seconds = std::chrono::duration<double>;
+using clock_type = std::chrono::steady_clock;
+
+struct timing { double insert, lookup, erase; };
+
+template <class Set>
+static bool lookup(const Set& s, int key)
+{ return s.find(key) != s.end(); }
+
+template <class Set>
+static timing bench(const std::vector<int>& keys,
+                    const std::vector<int>& probes, long& check) {
+  timing t;
+  Set s;
+  auto t0 = clock_type::now();
+  for (int key : keys)
+    s.insert(key);
+  auto t1 = clock_type::now();
+  long found = 0;
+  for (int key : probes)
+    found += lookup(s, key);
+  auto t2 = clock_type::now();
+  for (size_t i = 0; i < keys.size(); i += 2)
+    s.erase(keys[i]);
+  auto t3 = clock_type::now();
+  double n = keys.size();
+  t.insert = seconds(t1 - t0).count() * 1e9 / n;
+  t.lookup = seconds(t2 - t1).count() * 1e9 / n;
+  t.erase = seconds(t3 - t2).count() * 1e9 / (n / 2);
+  check += found + s.size();
+  return t;
+}
+
+static void print(const char* name, size_t n, const timing& t) {
+  printf("%-10s %10zu %10.1f %10.1f %10.1f\n", name, n, t.insert, t.lookup,
+         t.erase);
+}
+
+int main(int argc, const char* argv[]) {
+  int maxexp = argc > 1 ? atoi(argv[1]) : 6;
+  printf("\033[32m\033[1mrandom ints, ns per op; btree node bytes 256 "
+         "(%d keys per leaf, %d per inner node)\033[0m\n",
+         btree<int, int, btree_identity>::LEAFMAX,
+         btree<int, int, btree_identity>::INNERMAX);
+  printf("\033[34mcontainer           keys     insert     lookup"
+         "      erase\033[0m\n");
+  long check = 0;
+  for (int e = 3; e <= maxexp; e++) {
+    size_t n = 1;
+    for (int i = 0; i < e; i++)
+      n *= 10;
+    std::mt19937 rng(42);
+    std::vector<int> keys(n), probes(n);
+    for (auto&& x : keys)
+      x = rng();
+    for (size_t i = 0; i < n; i++)
+      probes[i] = i % 2 ? keys[rng() % n] : (int)rng();
+    print("btree_set", n, bench<btree_set<int>>(keys, probes, check));
+    print("set", n, bench<set<int>>(keys, probes, check));
+    print("avltree", n, bench<avltree<int>>(keys, probes, check));
+    print("std::set", n, bench<std::set<int>>(keys, probes, check));
+  }
+  printf("checksum %ld\n", check);
+  return 0;
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include "mempool.h"
+
+/**
+ * @brief epoch based reclamation for lock-free containers.
+ *
+ * A thread reads shared nodes only between enter() and leave(), which
+ * announce the global epoch it started in. A node unlinked by a writer
+ * is retire()d, tagged with the global epoch seen after the unlink,
+ * and freed once the epoch has moved two further: the global epoch
+ * only advances when every thread inside a critical section has seen
+ * the current one, so by then none of them can still hold the node.
+ *
+ * Retired nodes wait in per-thread bags, one per epoch modulo 3, and
+ * are freed by the thread that retired them. A thread's record, bags
+ * included, is handed to the next thread once it exits.
+ */
+class epoch_domain {
+ public:
+  static constexpr unsigned ADVANCE = 64;  /* retires per advance attempt */
+
+ protected:
+  struct retired {
+    void* ptr;
+    void (*deleter)(void*);
+  };
+
+  struct alignas(64) record {
+    std::atomic<uint64_t> m_epoch{0};  /* epoch << 1 | 1 while inside */
+    std::atomic<bool> m_used{true};
+    record* m_next = nullptr;          /* set once, before publishing */
+    unsigned m_nest = 0;
+    unsigned m_retires = 0;
+    std::vector<retired> m_bag[3];
+    uint64_t m_bag_epoch[3] = {0, 0, 0};
+  };
+
+  struct holder {
+    record* m_record = nullptr;
+
+    ~holder() {
+      if (m_record != nullptr)
+        epoch_domain::instance().release(m_record);
+    }
+  };
+
+  std::atomic<uint64_t> m_global{2};
+  std::atomic<record*> m_records{nullptr};
+
+  // the pool must outlive the nodes freed by the destructor.
+  epoch_domain() { tiny_mempool::instance(); }
+
+  ~epoch_domain() {
+    record* r = m_records.load();
+    while (r != nullptr) {
+      record* next = r->m_next;
+      for (auto& bag : r->m_bag)
+        free_bag(bag);
+      r->~record();
+      free(r);
+      r = next;
+    }
+  }
+
+ public:
+  epoch_domain(const epoch_domain&) = delete;
+
+  epoch_domain& operator=(const epoch_domain&) = delete;
+
+  static epoch_domain& instance() {
+    static epoch_domain domain;
+    return domain;
+  }
+
+  /**
+   * @brief start a critical section, they nest.
+   */
+  void enter() {
+    record* r = local();
+    if (r->m_nest++ == 0)
+      r->m_epoch.exchange(m_global.load() << 1 | 1);  // a full barrier
+  }
+
+  void leave() {
+    record* r = local();
+    if (--r->m_nest == 0)
+      r->m_epoch.store(0, std::memory_order_release);
+  }
+
+  /**
+   * @brief hand over an unlinked node, deleter(p) runs once no
+   * critical section can reach it. Call inside a critical section.
+   */
+  void retire(void* p, void (*deleter)(void*)) {
+    record* r = local();
+    uint64_t e = m_global.load();
+    collect(r, e);
+    int i = e % 3;
+    r->m_bag_epoch[i] = e;
+    r->m_bag[i].push_back(retired{p, deleter});
+    if (++r->m_retires % ADVANCE == 0 && try_advance(e))
+      collect(r, e + 1);
+  }
+
+  uint64_t epoch() const
+  { return m_global.load(); }
+
+ protected:
+  record* local() {
+    static thread_local holder h;
+    if (h.m_record == nullptr)
+      h.m_record = acquire();
+    return h.m_record;
+  }
+
+  record* acquire() {
+    for (record* r = m_records.load(); r != nullptr; r = r->m_next) {
+      bool used = false;
+      if (!r->m_used.load(std::memory_order_relaxed)
+          && r->m_used.compare_exchange_strong(used, true))
+        return r;
+    }
+    // operator new of C++14 ignores the alignment of record.
+    void* p = nullptr;
+    if (posix_memalign(&p, alignof(record), sizeof(record)) != 0)
+      throw std::bad_alloc();
+    record* r = new (p) record;
+    r->m_next = m_records.load();
+    while (!m_records.compare_exchange_weak(r->m_next, r)) {}
+    return r;
+  }
+
+  void release(record* r) {
+    collect(r, m_global.load());
+    r->m_used.store(false, std::memory_order_release);
+  }
+
+  // every thread inside a critical section has seen e.
+  bool try_advance(uint64_t e) {
+    for (record* r = m_records.load(); r != nullptr; r = r->m_next) {
+      uint64_t w = r->m_epoch.load();
+      if ((w & 1) && (w >> 1) != e)
+        return false;
+    }
+    return m_global.compare_exchange_strong(e, e + 1);
+  }
+
+  // free the bags retired two or more epochs before e.
+  static void collect(record* r, uint64_t e) {
+    for (int i = 0; i < 3; i++)
+      if (!r->m_bag[i].empty() && r->m_bag_epoch[i] + 2 <= e)
+        free_bag(r->m_bag[i]);
+  }
+
+  static void free_bag(std::vector<retired>& bag) {
+    for (const retired& x : bag)
+      x.deleter(x.ptr);
+    bag.clear();
+  }
+};
+
+/**
+ * @brief critical section of epoch_domain for the current scope.
+ */
+class epoch_guard {
+ public:
+  epoch_guard() { epoch_domain::instance().enter(); }
+
+  ~epoch_guard() { epoch_domain::instance().leave(); }
+
+  epoch_guard(const epoch_guard&) = delete;
+
+  epoch_guard& operator=(const epoch_guard&) = delete;
+};
@@ -0,0 +1,882 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <sys/mman.h>
+
+#define __TINY_MEMPOOL__
+
+/**
+ * @brief size class table of a pool, given as ascending multiples of 8.
+ * getindex() maps a request size to its class with one load from a
+ * table built at compile time, one entry per 8 bytes up to MAXSIZE.
+ */
+template <int... Sizes>
+struct mempool_size_classes {
+  static constexpr int CLASSES = sizeof...(Sizes);
+  static constexpr int sizes[CLASSES] = { Sizes... };
+  static constexpr int MAXSIZE = sizes[CLASSES - 1];
+
+  struct lookup_table
+  { unsigned char index[(MAXSIZE >> 3) + 1];
+
+    constexpr lookup_table() : index()
+    { int cls = 0;
+      for (int i = 0; i <= (MAXSIZE >> 3); i++)
+      { while (sizes[cls] < (i << 3)) cls++;
+        index[i] = cls;
+      }
+    }
+  };
+  static constexpr lookup_table table{};
+
+  static constexpr bool valid()
+  { for (int i = 0; i < CLASSES; i++)
+      if (sizes[i] % 8 != 0 || (i > 0 && sizes[i] <= sizes[i - 1]))
+        return false;
+    return sizes[0] >= 8 && CLASSES <= 256;
+  }
+  static_assert(valid(), "size classes must be ascending multiples of 8, "
+                         "from 8 up");
+
+  static int getindex(int size)
+  { return table.index[(size + 7) >> 3]; }
+
+  static int classsize(int index)
+  { return sizes[index]; }
+};
+
+template <int... Sizes>
+constexpr int mempool_size_classes<Sizes...>::sizes[];
+
+template <int... Sizes>
+constexpr typename mempool_size_classes<Sizes...>::lookup_table
+mempool_size_classes<Sizes...>::table;
+
+/* 8 byte steps up to 128, then 4 classes per power of two up to 4 KiB,
+ * so nodes holding a std::string or two are still pooled. */
+using tiny_size_classes = mempool_size_classes<
+    8,   16,   24,   32,   40,   48,   56,   64,
+   72,   80,   88,   96,  104,  112,  120,  128,
+  160,  192,  224,  256,  320,  384,  448,  512,
+  640,  768,  896, 1024, 1280, 1536, 1792, 2048,
+ 2560, 3072, 3584, 4096>;
+
+/**
+ * @brief snapshot of the pool counters, see basic_mempool::stats().
+ */
+struct mempool_stats {
+  struct size_class {
+    size_t size;                /* node size, 0 for blocks above MAXSIZE */
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t pool_hits;         /* served from a free node */
+    uint64_t malloc_fallbacks;  /* needed a new slab or a malloc */
+    uint64_t bytes_in_use;
+    uint64_t high_water;        /* peak of bytes_in_use */
+    uint64_t slabs;
+  };
+
+  std::vector<size_class> classes;
+  size_class total;  /* total.high_water sums the per-class peaks */
+
+  std::string to_json() const {
+    std::ostringstream os;
+    auto dump = [&os](const size_class& c) {
+      os << "{\"size\":" << c.size << ",\"allocs\":" << c.allocs
+         << ",\"frees\":" << c.frees << ",\"pool_hits\":" << c.pool_hits
+         << ",\"malloc_fallbacks\":" << c.malloc_fallbacks
+         << ",\"bytes_in_use\":" << c.bytes_in_use
+         << ",\"high_water\":" << c.high_water
+         << ",\"slabs\":" << c.slabs << '}';
+    };
+    os << "{\"total\":";
+    dump(total);
+    os << ",\"classes\":[";
+    for (size_t i = 0; i < classes.size(); i++) {
+      if (i != 0) os << ',';
+      dump(classes[i]);
+    }
+    os << "]}";
+    return os.str();
+  }
+};
+
+template <class Classes = tiny_size_classes>
+class basic_mempool {
+ public:
+  static constexpr int CLASSES = Classes::CLASSES;
+  static constexpr int MAXSIZE = Classes::MAXSIZE;
+  static constexpr size_t SLABSIZE = 64 << 10;
+  static constexpr size_t HUGESLABSIZE = 2 << 20;
+  /* refill() carves at least one block of each class out of a slab */
+  static_assert(MAXSIZE <= SLABSIZE, "size classes must fit in a slab");
+
+ protected:
+ struct memNode { memNode *nextnode = nullptr; };
+
+ /**
+  * @brief lock-free free-list head stored as one 64-bit word: the node
+  * address in the upper 48 bits and a version tag in the lower 16 bits
+  * plus the 3 alignment bits of the address. Every successful update
+  * bumps the tag, so a pop whose head was popped and pushed back in the
+  * meantime (ABA) fails its CAS instead of installing a stale link.
+  */
+ class taggedHead
+ { static_assert(sizeof(void *) == 8, "taggedHead needs 64-bit pointers");
+   static constexpr uint64_t TAGMASK = (1 << 19) - 1;
+
+   std::atomic<uint64_t> m_word{0};
+
+   static memNode *ptr(uint64_t w)
+   { return (memNode *)((w >> 16) & ~(uint64_t)7); }
+
+   static uint64_t make(memNode *p, uint64_t w)
+   { return ((uint64_t)p << 16) | ((w + 1) & TAGMASK); }
+
+  public:
+   memNode *load() const
+   { return ptr(m_word.load(std::memory_order_acquire)); }
+
+   memNode *pop()
+   { uint64_t w = m_word.load(std::memory_order_acquire);
+     memNode *p;
+     while ((p = ptr(w)) != nullptr
+         && !m_word.compare_exchange_weak(w, make(p->nextnode, w),
+              std::memory_order_acquire, std::memory_order_acquire))
+     ;
+     return p;
+   }
+
+   void push(memNode *first, memNode *last)
+   { uint64_t w = m_word.load(std::memory_order_relaxed);
+     do last->nextnode = ptr(w);
+     while (!m_word.compare_exchange_weak(w, make(first, w),
+              std::memory_order_release, std::memory_order_relaxed));
+   }
+
+   memNode *exchange(memNode *p)
+   { uint64_t w = m_word.load(std::memory_order_relaxed);
+     while (!m_word.compare_exchange_weak(w, make(p, w),
+              std::memory_order_acq_rel, std::memory_order_relaxed))
+     ;
+     return ptr(w);
+   }
+ };
+
+ /* slab headers live here, out of the slabs, so no node ever
+  * carries a header and the hot path never touches them. */
+ struct slab
+ { char *base;
+   size_t size;
+   bool mapped;
+ };
+
+ /**
+  * @brief live counters of one size class, each on its own cache line.
+  * Nodes in use are allocs - frees, so the fast path only bumps allocs
+  * or frees and keeps the high-water mark with a rarely failing CAS.
+  * Index CLASSES counts the blocks above MAXSIZE, in bytes.
+  */
+ struct alignas(64) classCounter
+ { std::atomic<uint64_t> allocs{0};
+   std::atomic<uint64_t> frees{0};
+   std::atomic<uint64_t> fallbacks{0};
+   std::atomic<int64_t> highwater{0};
+   std::atomic<int64_t> bytes{0};  /* blocks above MAXSIZE only */
+   std::atomic<uint64_t> slabs{0};
+ };
+
+ protected:
+  taggedHead m_free_head[CLASSES];
+  std::vector<slab> m_slabs[CLASSES];
+  std::mutex m_slab_lock;
+  std::atomic<bool> m_hugepage{false};
+  classCounter m_counter[CLASSES + 1];
+
+ private:
+  basic_mempool() {}
+
+ public:
+  /* the pool is never destroyed: a container with static storage
+   * duration built before its first use outlives any destructor of
+   * ours and frees its nodes at exit. trim() is the only path that
+   * gives slabs back to the system. */
+  static basic_mempool &instance()
+  { alignas(basic_mempool) static char storage[sizeof(basic_mempool)];
+    static basic_mempool *pool = new (storage) basic_mempool();
+    return *pool;
+  }
+
+  static int getindex(int size)
+  { return Classes::getindex(size); }
+
+  static int classsize(int index)
+  { return Classes::classsize(index); }
+
+ public:
+  void *alloc(int size)
+  { if (size > MAXSIZE) return alloc_large(size);
+    int index = getindex(size);
+    memNode *p = pop(index);
+    if (p == nullptr)
+    { int count = 1;
+      account(index, 1, 0, 1);
+      return refill(index, count, p);
+    }
+    account(index, 1, 0, 0);
+    return p;
+  }
+
+  void delloc(void *ptr, int size)
+  { if (ptr == nullptr) return;
+    if (size > MAXSIZE) return delloc_large(ptr, size);
+    int index = getindex(size);
+    memNode *pNew = (memNode *)ptr;
+    m_free_head[index].push(pNew, pNew);
+    account(index, 0, 1, 0);
+  }
+
+  void *alloc_large(int size)
+  { classCounter &c = m_counter[CLASSES];
+    c.allocs.fetch_add(1, std::memory_order_relaxed);
+    c.fallbacks.fetch_add(1, std::memory_order_relaxed);
+    int64_t live = c.bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    raise(c.highwater, live);
+    return malloc(size);
+  }
+
+  void delloc_large(void *ptr, int size)
+  { classCounter &c = m_counter[CLASSES];
+    c.frees.fetch_add(1, std::memory_order_relaxed);
+    c.bytes.fetch_sub(size, std::memory_order_relaxed);
+    free(ptr);
+  }
+
+  /**
+   * @brief add to the counters of class `index`. Front ends that serve
+   * nodes without calling alloc/delloc (tiny_thread_cache) report the
+   * requests they served through here, in batches.
+   */
+  void account(int index, uint64_t allocs, uint64_t frees, uint64_t fallbacks)
+  { classCounter &c = m_counter[index];
+    if (fallbacks != 0)
+      c.fallbacks.fetch_add(fallbacks, std::memory_order_relaxed);
+    /* frees of a batch are counted after its allocs, so a batch
+     * that allocates and frees the same node still raises the mark. */
+    uint64_t f = frees == 0 ? c.frees.load(std::memory_order_relaxed)
+                            : c.frees.fetch_add(frees, std::memory_order_relaxed);
+    if (allocs != 0)
+    { uint64_t a = c.allocs.fetch_add(allocs, std::memory_order_relaxed);
+      raise(c.highwater, (int64_t)(a + allocs - f));
+    }
+  }
+
+  /**
+   * @brief read every counter without stopping the allocating threads.
+   * Each counter is exact, but they are read one by one, and requests
+   * still buffered by a thread cache are not counted yet.
+   */
+  mempool_stats stats() const
+  { mempool_stats st;
+    st.total = mempool_stats::size_class();
+    for (int i = 0; i <= CLASSES; i++)
+    { const classCounter &c = m_counter[i];
+      mempool_stats::size_class sc;
+      sc.size = i < CLASSES ? classsize(i) : 0;
+      sc.allocs = c.allocs.load(std::memory_order_relaxed);
+      sc.frees = c.frees.load(std::memory_order_relaxed);
+      sc.malloc_fallbacks = c.fallbacks.load(std::memory_order_relaxed);
+      sc.pool_hits = sc.allocs - std::min(sc.allocs, sc.malloc_fallbacks);
+      int64_t live = i < CLASSES ? (int64_t)(sc.allocs - sc.frees) * sc.size
+                                 : c.bytes.load(std::memory_order_relaxed);
+      int64_t peak = c.highwater.load(std::memory_order_relaxed);
+      if (i < CLASSES) peak *= sc.size;
+      sc.bytes_in_use = live > 0 ? live : 0;
+      sc.high_water = std::max(peak, live > 0 ? live : 0);
+      sc.slabs = c.slabs.load(std::memory_order_relaxed);
+      st.classes.push_back(sc);
+      st.total.allocs += sc.allocs;
+      st.total.frees += sc.frees;
+      st.total.pool_hits += sc.pool_hits;
+      st.total.malloc_fallbacks += sc.malloc_fallbacks;
+      st.total.bytes_in_use += sc.bytes_in_use;
+      st.total.high_water += sc.high_water;
+      st.total.slabs += sc.slabs;
+    }
+    return st;
+  }
+
+  /**
+   * @brief pop up to `count` nodes of class `index`.
+   * @return the popped chain (null-terminated), `count` is set to its length.
+   * When the free list runs short the chain is topped up from a new slab,
+   * and `fresh` tells whether the head of the chain comes from it.
+   * @note nodes are popped one by one: walking a shared chain to cut it
+   * with a single CAS could follow a link out of a node that another
+   * thread has already popped and overwritten.
+   */
+  void *alloc_batch(int index, int &count, bool &fresh)
+  { memNode *head = nullptr;
+    fresh = false;
+    int n = 0;
+    for (memNode *p; n < count && (p = pop(index)) != nullptr; n++)
+    { p->nextnode = head;
+      head = p;
+    }
+    if (n < count)
+    { int more = count - n;
+      memNode *last;
+      memNode *first = refill(index, more, last);
+      if (first != nullptr)
+      { last->nextnode = head;
+        head = first;
+        n += more;
+        fresh = true;
+      }
+    }
+    count = n;
+    return head;
+  }
+
+  /**
+   * @brief push a chain [first, last] of class `index` back to the
+   * free list with a single CAS.
+   */
+  void delloc_batch(int index, void *first, void *last)
+  { m_free_head[index].push((memNode *)first, (memNode *)last); }
+
+  /**
+   * @brief give every slab whose nodes are all back in the free
+   * lists to the operating system.
+   * @return number of bytes released.
+   * @attention Other threads must not alloc from the pool before
+   * this function return, they may read a node of a released slab.
+   */
+  size_t trim()
+  { std::lock_guard<std::mutex> locker(m_slab_lock);
+    size_t released = 0;
+    std::vector<memNode*> nodes;
+    for (int i = 0; i < CLASSES; i++)
+    { if (m_slabs[i].empty()) continue;
+      nodes.clear();
+      for (memNode *p = m_free_head[i].exchange(nullptr); p; p = p->nextnode)
+        nodes.push_back(p);
+      std::sort(nodes.begin(), nodes.end());
+      std::sort(m_slabs[i].begin(), m_slabs[i].end(),
+        [](const slab &x, const slab &y) { return x.base < y.base; });
+
+      size_t pernode = classsize(i);
+      memNode *first = nullptr, *last = nullptr;
+      auto node = nodes.begin();
+      auto keep = m_slabs[i].begin();
+      for (auto s = m_slabs[i].begin(); s != m_slabs[i].end(); ++s)
+      { while (node != nodes.end() && (char *)*node < s->base)
+          ++node;
+        auto begin = node;
+        while (node != nodes.end() && (char *)*node < s->base + s->size)
+          ++node;
+        if ((size_t)(node - begin) == s->size / pernode)
+        { freeslab(*s);
+          released += s->size;
+          m_counter[i].slabs.fetch_sub(1, std::memory_order_relaxed);
+          continue;
+        }
+        for (auto p = begin; p != node; ++p)
+        { (*p)->nextnode = first;
+          first = *p;
+          if (last == nullptr) last = first;
+        }
+        *keep++ = *s;
+      }
+      m_slabs[i].erase(keep, m_slabs[i].end());
+      if (first != nullptr)
+        delloc_batch(i, first, last);
+    }
+    return released;
+  }
+
+  /**
+   * @brief opt in (or out) of transparent huge pages. New slabs are then
+   * 2 MiB regions aligned on 2 MiB and advised with MADV_HUGEPAGE, so the
+   * nodes of a size class share a few TLB entries instead of one per
+   * 4 KiB page. Slabs already carved keep their backing.
+   * @return whether huge page slabs are in use: false when THP is
+   * disabled in the kernel, the pool then keeps 64 KiB slabs.
+   */
+  bool hugepage(bool on)
+  { m_hugepage = on && thp_available();
+    return m_hugepage;
+  }
+
+  static bool thp_available()
+  {
+#ifdef MADV_HUGEPAGE
+    FILE *fp = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (fp == nullptr) return false;
+    char mode[64] = { 0 };
+    size_t n = fread(mode, 1, sizeof(mode) - 1, fp);
+    fclose(fp);
+    return n > 0 && std::string(mode).find("[never]") == std::string::npos;
+#else
+    return false;
+#endif
+  }
+
+  /**
+   * @brief report the counters of every size class in use.
+   */
+  void report() const
+  { mempool_stats st = stats();
+    printf("\033[32m\033[1mtiny_mempool report\033[0m\n");
+    printf("\033[34mindex\tnode size       allocs   pool hits"
+           "   bytes in use   high water   slabs\033[0m\n");
+    for (int i = 0; i <= CLASSES; ++i)
+    { const mempool_stats::size_class &c = st.classes[i];
+      if (c.allocs == 0 && c.slabs == 0) continue;
+      if (i < CLASSES)
+        printf("\033[31m%5d\t%4zu \033[35mbyte\033[31m", i, c.size);
+      else
+        printf("\033[31m    -\t\033[35m    large\033[31m");
+      printf("   %10lu  %10lu   %12lu   %10lu   %5lu\033[0m\n",
+             c.allocs, c.pool_hits, c.bytes_in_use, c.high_water, c.slabs);
+    }
+  }
+
+ protected:
+  memNode *pop(int index)
+  { return m_free_head[index].pop(); }
+
+  /**
+   * @brief carve a new slab of class `index` into nodes. The first
+   * `count` of them are returned as a chain ending at `last`, the
+   * others are pushed to the free list.
+   * @return nullptr if the system is out of memory.
+   */
+  memNode *refill(int index, int &count, memNode *&last)
+  { slab s;
+    if (!(m_hugepage && newhugeslab(s)) && !newslab(s))
+      return nullptr;
+    { std::lock_guard<std::mutex> locker(m_slab_lock);
+      m_slabs[index].push_back(s);
+    }
+    m_counter[index].slabs.fetch_add(1, std::memory_order_relaxed);
+
+    int realsize = classsize(index);
+    int n = s.size / realsize;
+    if (count > n) count = n;
+    auto at = [&](int i) { return (memNode *)(s.base + i * realsize); };
+    for (int i = 0; i < n - 1; i++)
+      at(i)->nextnode = at(i + 1);
+    at(n - 1)->nextnode = nullptr;
+    last = at(count - 1);
+    last->nextnode = nullptr;
+    if (count < n)
+      delloc_batch(index, at(count), at(n - 1));
+    return at(0);
+  }
+
+  static void raise(std::atomic<int64_t> &highwater, int64_t live)
+  { int64_t peak = highwater.load(std::memory_order_relaxed);
+    while (live > peak && !highwater.compare_exchange_weak(peak, live,
+             std::memory_order_relaxed))
+    ;
+  }
+
+  static bool newslab(slab &s)
+  { s.size = SLABSIZE;
+    s.base = (char *)mmap(nullptr, s.size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    s.mapped = s.base != MAP_FAILED;
+    if (!s.mapped)
+      s.base = (char *)malloc(s.size);
+    return s.base != nullptr;
+  }
+
+  /* map twice the size and unmap the unaligned ends: mmap only
+   * guarantees 4 KiB alignment, a huge page needs 2 MiB. */
+  static bool newhugeslab(slab &s)
+  {
+#ifdef MADV_HUGEPAGE
+    s.size = HUGESLABSIZE;
+    s.mapped = true;
+    char *p = (char *)mmap(nullptr, 2 * s.size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return false;
+    s.base = (char *)(((uintptr_t)p + s.size - 1) & ~(uintptr_t)(s.size - 1));
+    if (s.base != p)
+      munmap(p, s.base - p);
+    munmap(s.base + s.size, p + s.size - s.base);
+    madvise(s.base, s.size, MADV_HUGEPAGE);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  static void freeslab(const slab &s)
+  { if (s.mapped)
+      munmap(s.base, s.size);
+    else
+      free(s.base);
+  }
+
+};
+
+using tiny_mempool = basic_mempool<>;
+
+/**
+ * @brief per-thread front end of a pool.
+ *
+ * Every thread owns one bounded magazine per size class. alloc/delloc
+ * only touch the magazine of the calling thread; the global free lists
+ * are hit once per half magazine, to refill an empty magazine or to flush
+ * half of a full one. A node may be freed by another thread than the
+ * one which allocated it: it simply lands in the freeing thread's
+ * magazine, and is flushed back to the global list from there.
+ * Magazines are returned to the global lists when their thread exits.
+ */
+template <class Pool = tiny_mempool>
+class tiny_thread_cache {
+ public:
+  static constexpr int CAPACITY = 64;
+  static constexpr int MAGBYTES = 32 << 10;
+  static constexpr unsigned PUBLISH = 256;
+
+ protected:
+ struct memNode { memNode *nextnode; };
+
+ struct magazine
+ { memNode *head = nullptr;
+   int count = 0;
+   int capacity;  /* at most CAPACITY nodes or MAGBYTES bytes */
+   /* requests not yet added to the pool counters */
+   unsigned allocs = 0;
+   unsigned frees = 0;
+   unsigned fallbacks = 0;
+ };
+
+ struct local_cache
+ { magazine mag[Pool::CLASSES];
+
+   local_cache()
+   { for (int i = 0; i < Pool::CLASSES; i++)
+     { int n = MAGBYTES / Pool::classsize(i);
+       if (n > CAPACITY) n = CAPACITY;
+       if (n < 2) n = 2;
+       mag[i].capacity = n;
+     }
+   }
+
+   ~local_cache()
+   { for (int i = 0; i < Pool::CLASSES; i++)
+     { flush(i, mag[i].count);
+       publish(i);
+     }
+   }
+
+   void publish(int index)
+   { magazine &m = mag[index];
+     Pool::instance().account(index, m.allocs, m.frees, m.fallbacks);
+     m.allocs = m.frees = m.fallbacks = 0;
+   }
+
+   // give the `count` coldest nodes of a magazine back to the pool.
+   void flush(int index, int count)
+   { magazine &m = mag[index];
+     if (count == 0) return;
+     int keep = m.count - count;
+     memNode *first = m.head;
+     if (keep == 0)
+       m.head = nullptr;
+     else
+     { memNode *p = m.head;
+       for (int n = 1; n < keep; n++)
+         p = p->nextnode;
+       first = p->nextnode;
+       p->nextnode = nullptr;
+     }
+     memNode *last = first;
+     for (int n = 1; n < count; n++)
+       last = last->nextnode;
+     m.count = keep;
+     Pool::instance().delloc_batch(index, first, last);
+   }
+ };
+
+  static local_cache &local()
+  { static thread_local local_cache cache;
+    return cache;
+  }
+
+  tiny_thread_cache() {}
+
+ public:
+  static tiny_thread_cache &instance()
+  { static tiny_thread_cache cache;
+    return cache;
+  }
+
+ public:
+  void *alloc(int size)
+  { if (size > Pool::MAXSIZE) return Pool::instance().alloc_large(size);
+    int index = Pool::getindex(size);
+    local_cache &cache = local();
+    magazine &m = cache.mag[index];
+    if (m.head == nullptr)
+    { int count = m.capacity / 2;
+      bool fresh;
+      m.head = (memNode *)Pool::instance().alloc_batch(index, count, fresh);
+      m.count = count;
+      if (m.head == nullptr) return nullptr;
+      m.fallbacks += fresh;
+    }
+    memNode *p = m.head;
+    m.head = p->nextnode;
+    m.count--;
+    if (++m.allocs + m.frees >= PUBLISH)
+      cache.publish(index);
+    return p;
+  }
+
+  void delloc(void *ptr, int size)
+  { if (ptr == nullptr) return;
+    if (size > Pool::MAXSIZE) return Pool::instance().delloc_large(ptr, size);
+    int index = Pool::getindex(size);
+    local_cache &cache = local();
+    magazine &m = cache.mag[index];
+    memNode *p = (memNode *)ptr;
+    p->nextnode = m.head;
+    m.head = p;
+    if (++m.count > m.capacity)
+      cache.flush(index, m.capacity / 2);
+    if (m.allocs + ++m.frees >= PUBLISH)
+      cache.publish(index);
+  }
+
+  /**
+   * @brief return the calling thread's magazines to the global lists.
+   */
+  void flush()
+  { local_cache &cache = local();
+    for (int i = 0; i < Pool::CLASSES; i++)
+    { cache.flush(i, cache.mag[i].count);
+      cache.publish(i);
+    }
+  }
+
+  /**
+   * @brief pool counters, with the calling thread's pending requests
+   * added. Other threads publish theirs every PUBLISH requests per
+   * size class, so each counter lags by at most that much per thread.
+   */
+  mempool_stats stats()
+  { local_cache &cache = local();
+    for (int i = 0; i < Pool::CLASSES; i++)
+      cache.publish(i);
+    return Pool::instance().stats();
+  }
+
+  /**
+   * @brief flush the calling thread's magazines and trim the pool.
+   * @attention Same restriction as Pool::trim().
+   */
+  size_t trim()
+  { flush();
+    return Pool::instance().trim();
+  }
+
+  bool hugepage(bool on)
+  { return Pool::instance().hugepage(on); }
+
+  void report()
+  { stats();
+    Pool::instance().report();
+  }
+
+};
+
+/**
+ * Pool used by tiny_allocator when none is given. Define
+ * TINY_MEMPOOL_NO_THREAD_CACHE to make every allocation go
+ * straight to the global lock-free lists.
+ */
+#ifdef TINY_MEMPOOL_NO_THREAD_CACHE
+using tiny_default_pool = tiny_mempool;
+#else
+using tiny_default_pool = tiny_thread_cache<tiny_mempool>;
+#endif
+
+template<class T, class Pool = tiny_default_pool>
+class tiny_allocator {
+ public:
+  using value_type = T;
+  using pointer = T*;
+  using const_pointer = const T*;
+  using reference = T&;
+  using const_reference = const T&;
+  using size_type = size_t;
+
+  tiny_allocator() {}
+
+  tiny_allocator(tiny_allocator const &) {}
+
+  tiny_allocator &operator=(tiny_allocator const &)
+  { return *this; }
+
+  template<class Other>
+  tiny_allocator(tiny_allocator<Other, Pool> const &) {}
+
+  template<class Other>
+  tiny_allocator &operator=(tiny_allocator<Other, Pool> const &)
+  { return *this; }
+
+  pointer allocate(size_type count)
+  { return (pointer)Pool::instance()
+      .alloc(count * sizeof(value_type));
+  }
+
+  void deallocate(pointer ptr, size_type count)
+  { return Pool::instance()
+      .delloc(ptr, count * sizeof(value_type));
+  }
+};
+
+/**
+ * @brief monotonic per-container allocator.
+ *
+ * Memory is bumped out of chunks that grow from 4 KiB to 1 MiB and is
+ * only handed back to the system by release(), all at once. Single
+ * objects given to deallocate() go to a free list and are reused by the
+ * next allocate(1), so erase-heavy containers don't grow without bound.
+ * Every copy of an arena_allocator is a new, empty arena: containers
+ * using it own their arena and may not exchange nodes with each other.
+ */
+template<class T>
+class arena_allocator {
+ public:
+  using value_type = T;
+  using pointer = T*;
+  using const_pointer = const T*;
+  using reference = T&;
+  using const_reference = const T&;
+  using size_type = size_t;
+
+  static constexpr size_t MINCHUNK = 4 << 10;
+  static constexpr size_t MAXCHUNK = 1 << 20;
+
+ protected:
+ struct chunk { chunk *next; size_t size; };
+ struct freeNode { freeNode *next; };
+
+  chunk *m_chunks = nullptr;
+  char *m_cur = nullptr;
+  char *m_end = nullptr;
+  freeNode *m_free = nullptr;
+
+ public:
+  arena_allocator() {}
+
+  arena_allocator(arena_allocator const &) {}
+
+  arena_allocator(arena_allocator &&x)
+  { steal(x); }
+
+  template<class Other>
+  arena_allocator(arena_allocator<Other> const &) {}
+
+  ~arena_allocator()
+  { release(); }
+
+  arena_allocator &operator=(arena_allocator const &)
+  { return *this; }
+
+  arena_allocator &operator=(arena_allocator &&x)
+  { if (this != &x)
+    { release();
+      steal(x);
+    }
+    return *this;
+  }
+
+  pointer allocate(size_type count)
+  { if (count == 1 && m_free != nullptr)
+    { freeNode *p = m_free;
+      m_free = p->next;
+      return (pointer)p;
+    }
+    size_t bytes = (count * sizeof(T) + alignof(std::max_align_t) - 1)
+                 & ~(alignof(std::max_align_t) - 1);
+    if ((size_t)(m_end - m_cur) < bytes)
+      grow(bytes);
+    char *p = m_cur;
+    m_cur += bytes;
+    return (pointer)p;
+  }
+
+  void deallocate(pointer ptr, size_type count)
+  { if (count == 1 && sizeof(T) >= sizeof(freeNode))
+    { freeNode *p = (freeNode *)ptr;
+      p->next = m_free;
+      m_free = p;
+    }
+  }
+
+  /**
+   * @brief give every chunk back at once. Objects still living in the
+   * arena are not destroyed.
+   */
+  void release()
+  { while (m_chunks != nullptr)
+    { chunk *next = m_chunks->next;
+      free(m_chunks);
+      m_chunks = next;
+    }
+    m_cur = m_end = nullptr;
+    m_free = nullptr;
+  }
+
+ protected:
+  void grow(size_t bytes)
+  { size_t size = m_chunks == nullptr ? MINCHUNK : m_chunks->size * 2;
+    if (size > MAXCHUNK) size = MAXCHUNK;
+    size_t header = (sizeof(chunk) + alignof(std::max_align_t) - 1)
+                  & ~(alignof(std::max_align_t) - 1);
+    if (size < header + bytes) size = header + bytes;
+    chunk *c = (chunk *)malloc(size);
+    if (c == nullptr) throw std::bad_alloc();
+    c->next = m_chunks;
+    c->size = size;
+    m_chunks = c;
+    m_cur = (char *)c + header;
+    m_end = (char *)c + size;
+  }
+
+  void steal(arena_allocator &x)
+  { m_chunks = x.m_chunks;
+    m_cur = x.m_cur;
+    m_end = x.m_end;
+    m_free = x.m_free;
+    x.m_chunks = nullptr;
+    x.m_cur = x.m_end = nullptr;
+    x.m_free = nullptr;
+  }
+};
+
+/* containers skip per-node teardown when their allocator is an arena. */
+template<class Alloc>
+struct is_arena_allocator : std::false_type {};
+
+template<class T>
+struct is_arena_allocator<arena_allocator<T>> : std::true_type {};
@@ -1,42 +1,146 @@
 /**
  * @file threadpool.h
  * @author your name (you@domain.com)
- * @brief 
+ * @brief
  * @version 0.1
  * @date 2023-04-04
- * 
+ *
  * @copyright Copyright (c) 2023
- * 
+ *
  * @note 写一个简单的线程池
  */
 
 #pragma once
+#include <atomic>
 #include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <vector>
 
+/**
+ * @brief Chase-Lev work-stealing deque of T*. The owner pushes and
+ * pops at the bottom without locking; any thread may steal from the
+ * top, racing the owner only for the last element. The ring doubles
+ * when full; outgrown rings are kept until the deque dies, as a thief
+ * may still read from one.
+ */
+template <typename T>
+class WorkStealingQueue {
+ public:
+  WorkStealingQueue() : array(new Array(64)) {
+    garbage.emplace_back(array.load(std::memory_order_relaxed));
+  }
+
+  WorkStealingQueue(const WorkStealingQueue&) = delete;
+
+  WorkStealingQueue& operator=(const WorkStealingQueue&) = delete;
+
+  // owner only.
+  void push(T* x) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    Array* a = array.load(std::memory_order_relaxed);
+    if (b - t > a->mask) {
+      a = a->grow(t, b);
+      garbage.emplace_back(a);
+      array.store(a, std::memory_order_release);
+    }
+    a->put(b, x);
+    bottom.store(b + 1, std::memory_order_release);
+  }
+
+  // owner only, newest first.
+  T* pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Array* a = array.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+    T* x = nullptr;
+    if (t <= b) {
+      x = a->get(b);
+      if (t == b) {
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed))
+          x = nullptr;
+        bottom.store(b + 1, std::memory_order_relaxed);
+      }
+    } else {
+      bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return x;
+  }
+
+  // any thread, oldest first; nullptr when empty or on a lost race.
+  T* steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b)
+      return nullptr;
+    Array* a = array.load(std::memory_order_acquire);
+    T* x = a->get(t);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed))
+      return nullptr;
+    return x;
+  }
+
+  bool empty() const {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_relaxed);
+    return t >= b;
+  }
+
+ private:
+  struct Array {
+    int64_t mask;
+    std::unique_ptr<std::atomic<T*>[]> slots;
+
+    explicit Array(int64_t size)
+      : mask(size - 1), slots(new std::atomic<T*>[size]) {}
+
+    T* get(int64_t i) const
+    { return slots[i & mask].load(std::memory_order_relaxed); }
+
+    void put(int64_t i, T* x)
+    { slots[i & mask].store(x, std::memory_order_relaxed); }
+
+    Array* grow(int64_t t, int64_t b) const {
+      Array* a = new Array(2 * (mask + 1));
+      for (int64_t i = t; i < b; i++)
+        a->put(i, get(i));
+      return a;
+    }
+  };
+
+  std::atomic<int64_t> top{0};
+  /* thieves write top, the owner bottom: keep them on separate lines */
+  char pad[64 - sizeof(std::atomic<int64_t>)];
+  std::atomic<int64_t> bottom{0};
+  std::atomic<Array*> array;
+  std::vector<std::unique_ptr<Array>> garbage;
+};
+
+/**
+ * @brief work-stealing thread pool. Every worker owns a
+ * WorkStealingQueue: a task added from inside a worker goes to the
+ * bottom of that worker's own deque, and idle workers steal from
+ * random victims. Only tasks from threads outside the pool go through
+ * the locked injection queue. Sleeping workers are woken only when
+ * some are asleep, so a busy pool never touches the condition
+ * variable.
+ */
 class ThreadPool {
  public:
-  ThreadPool(int nums = 8) : taskpool(std::make_shared<TaskPool>()) {
+  ThreadPool(int nums = 8) : taskpool(std::make_shared<TaskPool>(nums)) {
     for (int i = 0; i < nums; i++) {
-      threads.emplace_back([taskPool = taskpool] {
-        std::unique_lock<std::mutex> locker(taskPool->mtx);
-        while (true) {
-          if (!taskPool->tasks.empty()) {
-            auto task = std::move(taskPool->tasks.front());
-            taskPool->tasks.pop();
-            taskPool->mtx.unlock();
-            task();
-            taskPool->mtx.lock();
-          } else if (taskPool->isClosed) {
-            break;
-          }
-          taskPool->cv.wait(locker);
-        }
+      threads.emplace_back([taskPool = taskpool, i] {
+        taskPool->run(i);
       });
     }
   }
@@ -44,6 +148,8 @@ class ThreadPool {
   ThreadPool(ThreadPool&&) = default;
 
   ~ThreadPool() {
+    if (!taskpool)
+      return;
     {
       std::unique_lock<std::mutex> locker(taskpool->mtx);
       taskpool->isClosed = true;
@@ -54,25 +160,138 @@ class ThreadPool {
     }
   }
 
+  size_t size() const { return threads.size(); }
+
   template <class Callable>
   void addTask(Callable&& cb) {
-    {
-      std::unique_lock<std::mutex> locker(taskpool->mtx);
-      taskpool->tasks.emplace(std::forward<Callable>(cb));
-    }
-    taskpool->cv.notify_one();
+    taskpool->add(new CallBack(std::forward<Callable>(cb)));
   }
 
  private:
   using CallBack = std::function<void(void)>;
 
   struct TaskPool {
+    static constexpr int SPINS = 64;  /* empty scans before sleeping */
+
     bool isClosed{false};
-    std::queue<CallBack> tasks;
-    std::mutex mtx;
+    std::deque<CallBack*> injected;  /* tasks from outside the pool */
+    std::atomic<size_t> injectedCount{0};
+    std::atomic<int> sleepers{0};
+    std::mutex mtx;  /* guards isClosed and injected */
     std::condition_variable cv;
+    std::vector<std::unique_ptr<WorkStealingQueue<CallBack>>> workers;
+
+    explicit TaskPool(int nums) {
+      for (int i = 0; i < nums; i++)
+        workers.emplace_back(new WorkStealingQueue<CallBack>);
+    }
+
+    ~TaskPool() {
+      for (CallBack* task : injected)
+        delete task;
+    }
+
+    // the pool and index of the worker running on this thread.
+    static std::pair<TaskPool*, int>& self() {
+      static thread_local std::pair<TaskPool*, int> s(nullptr, -1);
+      return s;
+    }
+
+    void add(CallBack* task) {
+      auto& s = self();
+      if (s.first == this) {
+        workers[s.second]->push(task);
+      } else {
+        std::lock_guard<std::mutex> locker(mtx);
+        injected.push_back(task);
+        injectedCount.fetch_add(1, std::memory_order_relaxed);
+      }
+      // pairs with the fence in run(): either the sleeper sees the
+      // task, or we see the sleeper.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (sleepers.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> locker(mtx);
+        cv.notify_one();
+      }
+    }
+
+    CallBack* takeInjected() {
+      if (injectedCount.load(std::memory_order_relaxed) == 0)
+        return nullptr;
+      std::lock_guard<std::mutex> locker(mtx);
+      if (injected.empty())
+        return nullptr;
+      CallBack* task = injected.front();
+      injected.pop_front();
+      injectedCount.fetch_sub(1, std::memory_order_relaxed);
+      return task;
+    }
+
+    CallBack* steal(int self, uint64_t& seed) {
+      size_t n = workers.size();
+      for (size_t k = 0; k < n; k++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        size_t victim = seed % n;
+        if ((int)victim == self)
+          continue;
+        if (CallBack* task = workers[victim]->steal())
+          return task;
+      }
+      return nullptr;
+    }
+
+    CallBack* find(int i, uint64_t& seed) {
+      CallBack* task = workers[i]->pop();
+      if (task == nullptr)
+        task = takeInjected();
+      if (task == nullptr)
+        task = steal(i, seed);
+      return task;
+    }
+
+    bool idle() const {
+      if (injectedCount.load(std::memory_order_relaxed) != 0)
+        return false;
+      for (auto& w : workers)
+        if (!w->empty())
+          return false;
+      return true;
+    }
+
+    void run(int i) {
+      self() = std::make_pair(this, i);
+      uint64_t seed = 0x9E3779B97F4A7C15ull * (i + 1);
+      int spins = 0;
+      while (true) {
+        if (CallBack* task = find(i, seed)) {
+          (*task)();
+          delete task;
+          spins = 0;
+          continue;
+        }
+        if (++spins < SPINS) {
+          std::this_thread::yield();
+          continue;
+        }
+        spins = 0;
+        std::unique_lock<std::mutex> locker(mtx);
+        sleepers.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (idle()) {
+          if (isClosed) {
+            sleepers.fetch_sub(1, std::memory_order_relaxed);
+            break;
+          }
+          cv.wait(locker);
+        }
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+      }
+      self() = std::make_pair(nullptr, -1);
+    }
   };
 
   std::shared_ptr<TaskPool> taskpool;
   std::vector<std::thread> threads;
-};
\ No newline at end of file
+};
@@ -0,0 +1,97 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+#include "tree/rbtree.h"
+#include "tree/concurrent.h"
+
+/**
+ * concurrent_set (64 shards) against one rbtree behind one
+ * reader-writer lock, for 1 to 64 threads and several read / write
+ * mixes, in million operations per second over all threads. Writes
+ * are half inserts, half erases over a key range twice the preload.
+ *
+ * usage: concurbench [ops per thread, default 200000] [keys, default 1000000]
+ */
+
+using seconds = std::chrono::duration<double>;
+using clock_type = std::chrono::steady_clock;
+
+class locked_set {
+ public:
+  bool insert(int x) {
+    std::lock_guard<std::shared_timed_mutex> locker(m_lock);
+    return m_tree.insert_unique(x);
+  }
+
+  bool erase(int x) {
+    std::lock_guard<std::shared_timed_mutex> locker(m_lock);
+    return m_tree.erase(x) != 0;
+  }
+
+  bool contains(int x) const {
+    std::shared_lock<std::shared_timed_mutex> locker(m_lock);
+    return m_tree.contains(x);
+  }
+
+ private:
+  mutable std::shared_timed_mutex m_lock;
+  rbtree<int> m_tree;
+};
+
+template <class Set>
+static double run(Set& s, int threads, int reads, size_t ops, int range) {
+  std::vector<std::thread> workers;
+  std::vector<long> hits(threads);
+  auto t0 = clock_type::now();
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      std::mt19937 rng(t + 1);
+      long h = 0;
+      for (size_t i = 0; i < ops; i++) {
+        int key = rng() % range;
+        int op = rng() % 100;
+        if (op < reads)
+          h += s.contains(key);
+        else if (op % 2)
+          h += s.insert(key);
+        else
+          h += s.erase(key);
+      }
+      hits[t] = h;
+    });
+  }
+  for (auto& w : workers)
+    w.join();
+  auto t1 = clock_type::now();
+  return threads * ops / seconds(t1 - t0).count() / 1e6;
+}
+
+int main(int argc, const char* argv[]) {
+  size_t ops = argc > 1 ? atol(argv[1]) : 200000;
+  int keys = argc > 2 ? atoi(argv[2]) : 1000000;
+  printf("\033[32m\033[1m%d preloaded keys, %zu ops per thread, "
+         "%u hardware threads, Mops/s\033[0m\n", keys, ops,
+         std::thread::hardware_concurrency());
+  printf("\033[34mthreads  reads%%  concurrent_set  locked rbtree\033[0m\n");
+  for (int reads : {50, 90, 99}) {
+    for (int threads = 1; threads <= 64; threads *= 2) {
+      concurrent_set<int> cs;
+      locked_set ls;
+      std::mt19937 rng(0);
+      for (int i = 0; i < keys; i++) {
+        int key = rng() % (2 * keys);
+        cs.insert(key);
+        ls.insert(key);
+      }
+      double a = run(cs, threads, reads, ops, 2 * keys);
+      double b = run(ls, threads, reads, ops, 2 * keys);
+      printf("%7d %7d %15.2f %14.2f\n", threads, reads, a, b);
+    }
+  }
+  return 0;
+}
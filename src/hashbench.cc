@@ -0,0 +1,66 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include "tree/rbtree.h"
+#include "tree/hashmap.h"
+
+/**
+ * flat_hash_map against map (rbtree) and std::unordered_map: n random
+ * inserts, n point lookups (half of them hits) and n / 2 erases, in
+ * ns per operation.
+ *
+ * usage: hashbench [n, default 1000000]
+ */
+
+using seconds = std::chrono::duration<double>;
+using clock_type = std::chrono::steady_clock;
+
+template <class Map>
+static void bench(const char* name, const std::vector<int>& keys,
+                  const std::vector<int>& probes) {
+  Map m;
+  auto t0 = clock_type::now();
+  for (int key : keys)
+    m.insert(std::pair<int, int>(key, key));
+  auto t1 = clock_type::now();
+  long found = 0;
+  for (int key : probes)
+    found += m.find(key) != m.end();
+  auto t2 = clock_type::now();
+  for (size_t i = 0; i < keys.size(); i += 2)
+    m.erase(std::pair<int, int>(keys[i], 0));
+  auto t3 = clock_type::now();
+  double n = keys.size();
+  printf("%-20s %10.1f %10.1f %10.1f %10ld %10zu\n", name,
+         seconds(t1 - t0).count() * 1e9 / n,
+         seconds(t2 - t1).count() * 1e9 / n,
+         seconds(t3 - t2).count() * 1e9 / (n / 2), found, m.size());
+}
+
+// std::unordered_map::erase takes a key.
+struct std_unordered_map : std::unordered_map<int, int> {
+  using std::unordered_map<int, int>::erase;
+  size_t erase(const std::pair<int, int>& x)
+  { return std::unordered_map<int, int>::erase(x.first); }
+};
+
+int main(int argc, const char* argv[]) {
+  size_t n = argc > 1 ? atol(argv[1]) : 1000000;
+  std::mt19937 rng(42);
+  std::vector<int> keys(n), probes(n);
+  for (auto&& x : keys)
+    x = rng();
+  for (size_t i = 0; i < n; i++)
+    probes[i] = i % 2 ? keys[rng() % n] : (int)rng();
+
+  printf("\033[32m\033[1m%zu random ints, ns per op\033[0m\n", n);
+  printf("\033[34mcontainer                insert     lookup      erase"
+         "      found       size\033[0m\n");
+  bench<map<int, int>>("map", keys, probes);
+  bench<flat_hash_map<int, int>>("flat_hash_map", keys, probes);
+  bench<std_unordered_map>("std::unordered_map", keys, probes);
+  return 0;
+}
@@ -0,0 +1,73 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "tree/rbtree.h"
+
+/**
+ * Lookup throughput of a large rbtree with the pool on 64 KiB slabs and
+ * on 2 MiB transparent huge pages. The tree is built from shuffled keys
+ * so that neighbouring nodes in the tree are far apart in memory.
+ */
+
+static long anon_hugepages_kb() {
+  FILE* fp = fopen("/proc/self/smaps_rollup", "r");
+  if (fp == nullptr) return -1;
+  char line[256];
+  long kb = -1;
+  while (fgets(line, sizeof(line), fp))
+    if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1)
+      break;
+  fclose(fp);
+  return kb;
+}
+
+static void bench(const char* name, const std::vector<int>& keys,
+                  const std::vector<int>& probes) {
+  rbtree<int> tree;
+  auto start = std::chrono::steady_clock::now();
+  for (int key : keys)
+    tree.insert_unique(key);
+  std::chrono::duration<double> build =
+      std::chrono::steady_clock::now() - start;
+
+  long found = 0;
+  start = std::chrono::steady_clock::now();
+  for (int key : probes)
+    found += tree.lower_bound(key)->m_data == key;
+  std::chrono::duration<double> lookup =
+      std::chrono::steady_clock::now() - start;
+
+  printf("%-18s %10.2f %14.2f %14ld %10ld\n", name, build.count(),
+         probes.size() / lookup.count() * 1e-6, anon_hugepages_kb() >> 10,
+         found);
+}
+
+int main(int argc, const char* argv[]) {
+  size_t n = argc > 1 ? atol(argv[1]) : 10000000;
+  size_t m = argc > 2 ? atol(argv[2]) : 10000000;
+  std::mt19937 rng(42);
+  std::vector<int> keys(n);
+  for (size_t i = 0; i < n; i++)
+    keys[i] = 2 * i;
+  std::shuffle(keys.begin(), keys.end(), rng);
+  std::vector<int> probes(m);
+  for (auto&& x : probes)
+    x = rng() % (2 * n - 1);
+
+  printf("\033[32m\033[1mrbtree<int> lookup, %zu nodes, %zu lookups\033[0m\n",
+         n, m);
+  printf("\033[34mslabs              build (s)   Mlookups/sec"
+         "   THP (MiB)      found\033[0m\n");
+  tiny_default_pool::instance().hugepage(false);
+  bench("64 KiB", keys, probes);
+  tiny_default_pool::instance().trim();
+  if (!tiny_default_pool::instance().hugepage(true)) {
+    printf("transparent huge pages are not available\n");
+    return 0;
+  }
+  bench("2 MiB huge pages", keys, probes);
+  return 0;
+}
@@ -0,0 +1,68 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "tree/rbtree.h"
+#include "tree/idxrbtree.h"
+
+/**
+ * Pointer-linked rbtree (plain and compact nodes) against the 32-bit
+ * index-linked idxrbtree: n random inserts, n lookups, one in-order
+ * walk and one copy of the whole tree.
+ */
+
+using seconds = std::chrono::duration<double>;
+using clock_type = std::chrono::steady_clock;
+
+template <class Tree>
+static bool contains(const Tree& tree, int key)
+{ return tree.find(key) != tree.end().node(); }
+
+static bool contains(const idxrbtree<int>& tree, int key)
+{ return tree.contains(key); }
+
+template <class Tree>
+static void bench(const char* name, const std::vector<int>& keys,
+                  const std::vector<int>& probes) {
+  Tree tree;
+  auto t0 = clock_type::now();
+  for (int key : keys)
+    tree.insert_unique(key);
+  auto t1 = clock_type::now();
+  long found = 0;
+  for (int key : probes)
+    found += contains(tree, key);
+  auto t2 = clock_type::now();
+  long sum = 0;
+  for (int x : tree)
+    sum += x;
+  auto t3 = clock_type::now();
+  Tree copy(tree);
+  auto t4 = clock_type::now();
+  printf("%-16s %10.3f %10.3f %10.4f %10.4f %10ld %16ld\n", name,
+         seconds(t1 - t0).count(), seconds(t2 - t1).count(),
+         seconds(t3 - t2).count(), seconds(t4 - t3).count(), found,
+         sum + (long)copy.size());
+}
+
+int main(int argc, const char* argv[]) {
+  size_t n = argc > 1 ? atol(argv[1]) : 2000000;
+  std::mt19937 rng(42);
+  std::vector<int> keys(n), probes(n);
+  for (auto&& x : keys)
+    x = rng();
+  for (size_t i = 0; i < n; i++)
+    probes[i] = i % 2 ? keys[rng() % n] : (int)rng();
+
+  printf("\033[32m\033[1m%zu random ints, node bytes: rbtree %zu, "
+         "compact %zu, idxrbtree %zu\033[0m\n", n, sizeof(rbnode<int>),
+         sizeof(rbnode<int, rb_no_augment, rb_compact_layout>),
+         3 * sizeof(uint32_t) + sizeof(int));
+  printf("\033[34mcontainer        insert (s) lookup (s)   walk (s)"
+         "   copy (s)      found         checksum\033[0m\n");
+  bench<rbtree<int>>("rbtree", keys, probes);
+  bench<compact_rbtree<int>>("compact_rbtree", keys, probes);
+  bench<idxrbtree<int>>("idxrbtree", keys, probes);
+  return 0;
+}
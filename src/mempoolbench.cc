@@ -0,0 +1,128 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "components/mempool.h"
+
+/**
+ * Contention stress for the pool free lists: every thread keeps a ring
+ * of live blocks and replaces one of them per iteration, so each
+ * iteration is one alloc plus one delloc of the same size class.
+ * Each block is stamped with its owner on alloc and checked on delloc,
+ * a block handed out twice (the ABA symptom) shows up as a bad stamp.
+ */
+
+#define BENCH_SIZE 40
+#define BENCH_RING 64
+
+static std::atomic<long> g_badstamp{0};
+
+struct malloc_pool {
+  static malloc_pool& instance() { static malloc_pool pool; return pool; }
+  void* alloc(int size) { return malloc(size); }
+  void delloc(void* ptr, int) { free(ptr); }
+};
+
+template <class Pool>
+static void worker(long id, long iterations) {
+  Pool& pool = Pool::instance();
+  long* ring[BENCH_RING];
+  for (int i = 0; i < BENCH_RING; i++) {
+    ring[i] = (long*)pool.alloc(BENCH_SIZE);
+    ring[i][1] = id;
+  }
+  for (long n = 0; n < iterations; n++) {
+    int i = n % BENCH_RING;
+    if (ring[i][1] != id) g_badstamp++;
+    pool.delloc(ring[i], BENCH_SIZE);
+    ring[i] = (long*)pool.alloc(BENCH_SIZE);
+    ring[i][1] = id;
+  }
+  for (int i = 0; i < BENCH_RING; i++)
+    pool.delloc(ring[i], BENCH_SIZE);
+}
+
+template <class Pool>
+static void bench(const char* name, long iterations) {
+  printf("\033[32m\033[1m%s\033[0m\n", name);
+  printf("\033[34mthreads\t       Mops/sec   bad stamps\033[0m\n");
+  for (int nthreads = 1; nthreads <= 64; nthreads *= 2) {
+    g_badstamp = 0;
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < nthreads; i++)
+      threads.emplace_back(worker<Pool>, i, iterations);
+    for (auto&& t : threads)
+      t.join();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    double ops = 2.0 * iterations * nthreads / elapsed.count();
+    printf("%7d\t %14.2f   %10ld\n", nthreads, ops * 1e-6, g_badstamp.load());
+  }
+}
+
+/* the size class lookup tiny_mempool used before the lookup table. */
+struct scan_size_classes {
+  static constexpr int CLASSES = 16;
+  static constexpr int MAXSIZE = 128;
+
+  static int getindex(int size) {
+    static const unsigned int sizetable[CLASSES]
+    = { 8, 16, 24, 32, 40, 48, 56, 64, 72, 80, 88, 96, 104, 112, 120, 128 };
+    int __distance = 0;
+    for (; __distance < CLASSES; __distance++)
+      if (sizetable[__distance] >= size)
+        break;
+    return __distance;
+  }
+
+  static int classsize(int index) { return (index + 1) << 3; }
+};
+
+using table_size_classes = mempool_size_classes<
+  8, 16, 24, 32, 40, 48, 56, 64, 72, 80, 88, 96, 104, 112, 120, 128>;
+
+template <class Classes>
+static void bench_lookup(const char* name, long iterations) {
+  using Pool = basic_mempool<Classes>;
+  Pool& pool = Pool::instance();
+  void* ring[BENCH_RING];
+  int sizes[BENCH_RING];
+  for (int i = 0; i < BENCH_RING; i++) {
+    sizes[i] = 8;
+    ring[i] = pool.alloc(sizes[i]);
+  }
+  volatile int sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (long n = 0; n < iterations; n++)
+    sink = sink + Classes::getindex((n * 7 & 127) + 1);
+  std::chrono::duration<double, std::nano> lookup =
+      std::chrono::steady_clock::now() - start;
+  start = std::chrono::steady_clock::now();
+  for (long n = 0; n < iterations; n++) {
+    int i = n % BENCH_RING;
+    pool.delloc(ring[i], sizes[i]);
+    sizes[i] = (n * 7 & 127) + 1;
+    ring[i] = pool.alloc(sizes[i]);
+  }
+  std::chrono::duration<double, std::nano> alloc =
+      std::chrono::steady_clock::now() - start;
+  for (int i = 0; i < BENCH_RING; i++)
+    pool.delloc(ring[i], sizes[i]);
+  printf("%-16s %10.2f %16.2f\n", name, lookup.count() / iterations,
+         alloc.count() / iterations);
+}
+
+int main(int argc, const char* argv[]) {
+  long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+  printf("\033[32m\033[1msize class lookup (sizes 1..128)\033[0m\n");
+  printf("\033[34mclasses          lookup ns/op  alloc+free ns/op\033[0m\n");
+  bench_lookup<scan_size_classes>("linear scan", iterations);
+  bench_lookup<table_size_classes>("lookup table", iterations);
+  bench<tiny_mempool>("tiny_mempool (global lists)", iterations);
+  bench<tiny_thread_cache<tiny_mempool>>("tiny_thread_cache", iterations);
+  bench<malloc_pool>("malloc", iterations);
+  return 0;
+}
@@ -0,0 +1,143 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include "components/threadpool.h"
+
+/**
+ * ThreadPool (work stealing) against the previous design, kept below
+ * as LockedThreadPool: one std::queue behind one mutex and a notify
+ * per task. Two loads of tiny tasks, in million tasks per second:
+ *   external  the main thread submits every task
+ *   nested    tasks fork a binary tree of tasks from inside the pool
+ *
+ * usage: poolbench [tasks, default 262143] [max workers, default 64]
+ */
+
+class LockedThreadPool {
+ public:
+  LockedThreadPool(int nums = 8) : taskpool(std::make_shared<TaskPool>()) {
+    for (int i = 0; i < nums; i++) {
+      threads.emplace_back([taskPool = taskpool] {
+        std::unique_lock<std::mutex> locker(taskPool->mtx);
+        while (true) {
+          if (!taskPool->tasks.empty()) {
+            auto task = std::move(taskPool->tasks.front());
+            taskPool->tasks.pop();
+            taskPool->mtx.unlock();
+            task();
+            taskPool->mtx.lock();
+          } else if (taskPool->isClosed) {
+            break;
+          } else {
+            taskPool->cv.wait(locker);
+          }
+        }
+      });
+    }
+  }
+
+  ~LockedThreadPool() {
+    {
+      std::unique_lock<std::mutex> locker(taskpool->mtx);
+      taskpool->isClosed = true;
+    }
+    taskpool->cv.notify_all();
+    for (auto&& thread : threads) {
+      thread.join();
+    }
+  }
+
+  size_t size() const { return threads.size(); }
+
+  template <class Callable>
+  void addTask(Callable&& cb) {
+    {
+      std::unique_lock<std::mutex> locker(taskpool->mtx);
+      taskpool->tasks.emplace(std::forward<Callable>(cb));
+    }
+    taskpool->cv.notify_one();
+  }
+
+ private:
+  using CallBack = std::function<void(void)>;
+
+  struct TaskPool {
+    bool isClosed{false};
+    std::queue<CallBack> tasks;
+    std::mutex mtx;
+    std::condition_variable cv;
+  };
+
+  std::shared_ptr<TaskPool> taskpool;
+  std::vector<std::thread> threads;
+};
+
+using seconds = std::chrono::duration<double>;
+using clock_type = std::chrono::steady_clock;
+
+static std::atomic<long> done{0};
+
+static void wait_for(long n) {
+  while (done.load(std::memory_order_acquire) < n)
+    std::this_thread::yield();
+}
+
+template <class Pool>
+static void fork(Pool& pool, int depth) {
+  done.fetch_add(1, std::memory_order_release);
+  if (depth == 0)
+    return;
+  pool.addTask([&pool, depth] { fork(pool, depth - 1); });
+  pool.addTask([&pool, depth] { fork(pool, depth - 1); });
+}
+
+template <class Pool>
+static double external(int workers, long n) {
+  Pool pool(workers);
+  done = 0;
+  auto t0 = clock_type::now();
+  for (long i = 0; i < n; i++)
+    pool.addTask([] { done.fetch_add(1, std::memory_order_release); });
+  wait_for(n);
+  return n / seconds(clock_type::now() - t0).count() / 1e6;
+}
+
+template <class Pool>
+static double nested(int workers, int depth) {
+  Pool pool(workers);
+  long n = (2L << depth) - 1;
+  done = 0;
+  auto t0 = clock_type::now();
+  pool.addTask([&pool, depth] { fork(pool, depth); });
+  wait_for(n);
+  return n / seconds(clock_type::now() - t0).count() / 1e6;
+}
+
+int main(int argc, const char* argv[]) {
+  long n = argc > 1 ? atol(argv[1]) : 262143;
+  int maxworkers = argc > 2 ? atoi(argv[2]) : 64;
+  int depth = 0;
+  while ((2L << (depth + 1)) - 1 <= n)
+    ++depth;
+  printf("\033[32m\033[1m%ld external tasks, %ld nested tasks, "
+         "%u hardware threads\033[0m\n", n, (2L << depth) - 1,
+         std::thread::hardware_concurrency());
+  printf("\033[34mworkers   external: locked   stealing"
+         "    nested: locked   stealing  (Mtasks/s)\033[0m\n");
+  for (int w = 1; w <= maxworkers; w *= 2) {
+    double e1 = external<LockedThreadPool>(w, n);
+    double e2 = external<ThreadPool>(w, n);
+    double n1 = nested<LockedThreadPool>(w, depth);
+    double n2 = nested<ThreadPool>(w, depth);
+    printf("%7d %18.2f %10.2f %18.2f %10.2f\n", w, e1, e2, n1, n2);
+  }
+  return 0;
+}
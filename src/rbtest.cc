@@ -1,8 +1,11 @@
 #include <thread>
 #include <mutex>
 #include <cassert>
+#include <cstdio>
+#include <string>
 #include <vector>
 #include "tree/rbtree.h"
+#include "tree/skiplist.h"
 
 using namespace std::chrono;
 
@@ -29,6 +32,56 @@ static void test_rbtree() {
     }
 }
 
+// built before the pool's first use and destroyed at exit, after
+// every static constructed later: the pool must still be there.
+set<int> survivor;
+
+static void test_static_set() {
+    for (int i = 0; i < 100000; i++)
+        survivor.insert(i);
+    assert(survivor.size() == 100000);
+}
+
+skiplist_set<int> shared;
+
+// every thread owns the keys equal to its index modulo the thread
+// count, so it knows which of its inserts and erases must succeed
+// while all of them link and unlink towers in the same lists.
+static void test_skiplist(int id, int threads) {
+    for (int i = 0; i < TEST_EPOCH / 10; i++) {
+        for (int j = 0; j < TEST_COUNT; j++) {
+            bool inserted = shared.insert(j * threads + id);
+            assert(inserted);
+            (void)inserted;
+        }
+        for (int j = 0; j < TEST_COUNT; j++) {
+            bool found = shared.contains(j * threads + id);
+            assert(found);
+            (void)found;
+        }
+        for (int j = 0; j < TEST_COUNT; j++) {
+            bool erased = shared.erase(j * threads + id);
+            assert(erased);
+            (void)erased;
+        }
+    }
+}
+
+// lookups with a key type other than the stored one, as on set / map.
+static void test_skiplist_lookup() {
+    skiplist_set<long> s;
+    for (long i = 0; i < TEST_COUNT; i++)
+        s.insert(2 * i);
+    assert(s.contains(2) && !s.contains(3) && s.count(4) == 1);
+    assert(s.find(6) != s.end() && *s.lower_bound(7) == 8);
+
+    skiplist_map<std::string, int> m;
+    m.try_emplace("a", 1);
+    m.try_emplace("c", 3);
+    assert(m.contains("a") && !m.contains("b"));
+    assert(m.find("c")->second == 3 && m.lower_bound("b")->first == "c");
+}
+
 int main(int argc, const char* argv[]) {
     srand(time(NULL));
     std::vector<std::thread> threads;
@@ -38,6 +91,14 @@ int main(int argc, const char* argv[]) {
     }
     for (auto&& t : threads)
         t.join();
+    test_static_set();
+    threads.clear();
+    for (int i = 0; i < TEST_THREAD; i++)
+        threads.emplace_back(test_skiplist, i, TEST_THREAD);
+    for (auto&& t : threads)
+        t.join();
+    assert(shared.empty() && shared.isvalid());
+    test_skiplist_lookup();
     tiny_mempool::instance().report();
     return 0;
 }
\ No newline at end of file
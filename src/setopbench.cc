@@ -0,0 +1,78 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+#include "tree/rbtree.h"
+
+/**
+ * Merging m random keys into a set of n: one insert_unique per key
+ * against the join-based set_union, alone and on a thread pool.
+ * Building the inputs is not timed.
+ *
+ * usage: setopbench [n, default 1000000] [rounds, default 3]
+ */
+
+using seconds = std::chrono::duration<double>;
+
+static std::vector<int> random_keys(size_t n, std::mt19937& rng) {
+  std::vector<int> keys(n);
+  for (auto&& x : keys)
+    x = rng();
+  return keys;
+}
+
+template <class Op>
+static double bench(const std::vector<int>& base, 
+                    const std::vector<int>& incoming, int rounds, 
+                    size_t& result, Op op) {
+  seconds total(0);
+  for (int r = 0; r < rounds; r++) {
+    rbtree<int> a, b;
+    a.assign_unique(base.begin(), base.end());
+    b.assign_unique(incoming.begin(), incoming.end());
+    auto t0 = std::chrono::steady_clock::now();
+    op(a, b);
+    total += std::chrono::steady_clock::now() - t0;
+    result = a.size();
+  }
+  return total.count() / rounds;
+}
+
+int main(int argc, const char* argv[]) {
+  size_t n = argc > 1 ? atol(argv[1]) : 1000000;
+  int rounds = argc > 2 ? atoi(argv[2]) : 3;
+  if (rounds < 1) {
+    fprintf(stderr, "rounds must be at least 1\n");
+    return 1;
+  }
+  int threads = std::thread::hardware_concurrency();
+  ThreadPool pool(threads > 0 ? threads : 1);
+  std::mt19937 rng(42);
+  std::vector<int> base = random_keys(n, rng);
+  std::sort(base.begin(), base.end());
+
+  printf("\033[32m\033[1mmerge m keys into a set of %zu, %d rounds, "
+         "%zu pool threads\033[0m\n", n, rounds, pool.size());
+  printf("\033[34m         m  insert_unique (s)  set_union (s)"
+         "  set_union+pool (s)       size\033[0m\n");
+  for (size_t m = 1000; m <= n; m *= 10) {
+    std::vector<int> incoming = random_keys(m, rng);
+    std::sort(incoming.begin(), incoming.end());
+    size_t s1 = 0, s2 = 0, s3 = 0;
+    double t1 = bench(base, incoming, rounds, s1, [](rbtree<int>& a, rbtree<int>& b) {
+      for (auto it = b.begin(); it != b.end(); ++it)
+        a.insert_unique(*it);
+    });
+    double t2 = bench(base, incoming, rounds, s2, [](rbtree<int>& a, rbtree<int>& b) {
+      a.set_union(std::move(b));
+    });
+    double t3 = bench(base, incoming, rounds, s3, [&](rbtree<int>& a, rbtree<int>& b) {
+      a.set_union(std::move(b), &pool);
+    });
+    printf("%10zu %18.4f %14.4f %19.4f %10zu%s\n", m, t1, t2, t3, s1,
+           s1 == s2 && s2 == s3 ? "" : "  MISMATCH");
+  }
+  return 0;
+}
@@ -0,0 +1,65 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "tree/skiplist.h"
+
+/**
+ * One skiplist_set mutated by 1 .. max threads at once. Every thread
+ * owns the keys equal to its index modulo the thread count and runs
+ * rounds of inserts, lookups and erases of its own keys, so each
+ * result is known and checked; a failed one is reported.
+ *
+ * usage: skiplistbench [max threads, default 20] [rounds, default 200]
+ *                      [keys per round, default 50]
+ */
+
+using seconds = std::chrono::duration<double>;
+using clock_type = std::chrono::steady_clock;
+
+static void worker(skiplist_set<int>& shared, int id, int threads,
+                   int rounds, int keys, long& failed) {
+  long bad = 0;
+  for (int i = 0; i < rounds; i++) {
+    for (int j = 0; j < keys; j++)
+      bad += !shared.insert(j * threads + id);
+    for (int j = 0; j < keys; j++)
+      bad += !shared.contains(j * threads + id);
+    for (int j = 0; j < keys; j++)
+      bad += !shared.erase(j * threads + id);
+  }
+  failed = bad;
+}
+
+int main(int argc, const char* argv[]) {
+  int maxthreads = argc > 1 ? atoi(argv[1]) : 20;
+  int rounds = argc > 2 ? atoi(argv[2]) : 200;
+  int keys = argc > 3 ? atoi(argv[3]) : 50;
+  printf("\033[32m\033[1m%d rounds of %d inserts, lookups, erases per "
+         "thread, %u hardware threads\033[0m\n", rounds, keys,
+         std::thread::hardware_concurrency());
+  printf("\033[34mthreads   time (s)    Mops/s   failed\033[0m\n");
+  for (int n = 1; n <= maxthreads; n = n * 2 > maxthreads && n < maxthreads
+                                          ? maxthreads : n * 2) {
+    skiplist_set<int> shared;
+    std::vector<std::thread> workers;
+    std::vector<long> failed(n);
+    auto t0 = clock_type::now();
+    for (int i = 0; i < n; i++)
+      workers.emplace_back(worker, std::ref(shared), i, n, rounds, keys,
+                           std::ref(failed[i]));
+    for (auto&& t : workers)
+      t.join();
+    double s = seconds(clock_type::now() - t0).count();
+    long bad = 0;
+    for (long f : failed)
+      bad += f;
+    bad += !shared.empty() || !shared.isvalid();
+    printf("%7d %10.3f %9.2f %8ld\n", n, s,
+           3.0 * rounds * keys * n / s / 1e6, bad);
+    if (bad != 0)
+      return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,76 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "tree/snapshot.h"
+
+/**
+ * Restart cost of a map: rebuilding it key by key against opening a
+ * saved snapshot with mapped_map, then random lookups on each. The
+ * snapshot file stays in the page cache, so open and first lookup
+ * time the mapping, not the disk.
+ *
+ * usage: snapbench [keys, default 4000000] [file, default snapbench.snap]
+ */
+
+using seconds = std::chrono::duration<double>;
+using clock_type = std::chrono::steady_clock;
+
+int main(int argc, const char* argv[]) {
+  size_t n = argc > 1 ? atol(argv[1]) : 4000000;
+  const char* path = argc > 2 ? argv[2] : "snapbench.snap";
+  std::mt19937_64 rng(42);
+  std::vector<std::pair<long, long>> input(n);
+  for (auto&& x : input)
+    x = {(long)(rng() >> 1), (long)rng()};
+  std::vector<long> probes(n);
+  for (size_t i = 0; i < n; i++)
+    probes[i] = i % 2 ? input[rng() % n].first : (long)(rng() >> 1);
+
+  printf("\033[32m\033[1m%zu random long -> long entries\033[0m\n", n);
+  printf("\033[34mstep                          time (s)\033[0m\n");
+  auto t0 = clock_type::now();
+  map<long, long> m;
+  for (const auto& x : input)
+    m.insert(x);
+  auto t1 = clock_type::now();
+  printf("%-28s %10.4f\n", "map rebuild by insert", seconds(t1 - t0).count());
+
+  t0 = clock_type::now();
+  if (!save_snapshot(path, m)) {
+    perror(path);
+    return 1;
+  }
+  t1 = clock_type::now();
+  printf("%-28s %10.4f\n", "save_snapshot", seconds(t1 - t0).count());
+
+  t0 = clock_type::now();
+  mapped_map<long, long> mm;
+  if (!mm.open(path)) {
+    fprintf(stderr, "%s: not a snapshot\n", path);
+    return 1;
+  }
+  t1 = clock_type::now();
+  long sum = mm.find(probes[1]) != mm.end();
+  auto t2 = clock_type::now();
+  printf("%-28s %10.6f\n", "mapped_map open", seconds(t1 - t0).count());
+  printf("%-28s %10.6f\n", "first lookup", seconds(t2 - t1).count());
+
+  t0 = clock_type::now();
+  for (long key : probes) {
+    auto it = m.find(key);
+    sum += it != m.end() ? it->second : 0;
+  }
+  t1 = clock_type::now();
+  for (long key : probes) {
+    auto it = mm.find(key);
+    sum -= it != mm.end() ? it.value() : 0;
+  }
+  t2 = clock_type::now();
+  printf("%-28s %10.4f\n", "map lookups", seconds(t1 - t0).count());
+  printf("%-28s %10.4f\n", "mapped_map lookups", seconds(t2 - t1).count());
+  printf("checksum %ld\n", sum);
+  unlink(path);
+  return 0;
+}
@@ -1,150 +1,74 @@
 #pragma once
 
-#include <atomic>
-#include <memory>
+#include <cstdlib>
+#include <iterator>
 #include <sstream>
 #include <iostream>
+#include <utility>
+#include "../components/mempool.h"
 
-#define __TINY_MEMPOOL__
-
-class tiny_mempool {
- protected:
- struct memNode { memNode *nextnode = nullptr; };
-
- protected:
-  std::atomic<memNode*> m_free_head[16];
-
- private:
-  tiny_mempool() {}
-
-  ~tiny_mempool()
-  { for (int i = 0; i < 16; i++)
-    { if (m_free_head[i] != nullptr)
-      { memNode *ptr = m_free_head[i];
-        while (ptr != nullptr)
-        { auto nptr = ptr->nextnode;
-          free(ptr);
-          ptr = nptr;
-        }
-      }
-      m_free_head[i] = nullptr;
-    }
-  }
-
-  int getindex(int size)
-  { static const unsigned int sizetable[16]
-    = { 8, 16, 24, 32, 40, 48, 56, 64, 72, 80, 88, 96, 104, 112, 120, 128 };
-    int __distance = 0;
-    for (; __distance < 16; __distance++)
-      if (sizetable[__distance] >= size)
-        break;
-    return __distance;
-  }
-
- public:
-  static tiny_mempool &instance()
-  { static tiny_mempool pool;
-    return pool;
-  }
-
- public:
-  void *alloc(int size)
-  { if (size > 128) return malloc(size);
-    int index = getindex(size);
-    int realsize = (index + 1) << 3;
-    memNode *p = m_free_head[index];
-    if (p == nullptr)
-      return malloc(realsize);
-    else
-    { while (!m_free_head[index].compare_exchange_weak(p, p->nextnode))
-        if (p == nullptr) return malloc(realsize);
-      return p;
-    }
-    return nullptr;
-  }
-
-  void delloc(void *ptr, int size)
-  { if (ptr == nullptr) return;
-    if (size > 128) return free(ptr);
-    int index = getindex(size);
-    memNode *pNew = (memNode *)ptr;
-    pNew->nextnode = m_free_head[index];
-    while (!(m_free_head[index].compare_exchange_weak(pNew->nextnode, pNew)))
-    ;
-  }
-  
-  /**
-   * @brief report memory distribute in the pool.
-   * @attention May cause undefined result if 
-   * allocate memory use current pool before this
-   * function return.
-   */
-  void report()
-  { printf("\033[32m\033[1mtiny_mempool report\033[0m\n");
-    printf("\033[34mindex\tnode size   node count\033[0m\n");
-    for (int i = 0; i < 16; ++i)
-    { int n = 0;
-      memNode *p = m_free_head[i];
-      while (p)
-      { n++;
-        p = p->nextnode;
-      }
-      printf("\033[31m%5d\t %3d \033[35mbyte\033[31m   %10d"
-             "\033[0m\n", i, (i + 1) << 3, n);
-    }
-  }
-
-};
-
-template<class T>
-class tiny_allocator { 
- public:
-  using value_type = T;
-  using pointer = T*;
-  using const_pointer = const T*;
-  using reference = T&;
-  using const_reference = const T&;
-  using size_type = size_t;
-
-  tiny_allocator() {}
-
-  tiny_allocator(tiny_allocator const &) {}
-
-  tiny_allocator &operator=(tiny_allocator const &)
-  { return *this; }
-
-  template<class Other>
-  tiny_allocator(tiny_allocator<Other> const &) {}
-
-  template<class Other>
-  tiny_allocator &operator=(tiny_allocator<Other> const &)
-  { return *this; }
-
-  pointer allocate(size_type count)
-  { return (pointer)tiny_mempool::instance()
-      .alloc(count * sizeof(value_type));
-  }
-
-  void deallocate(pointer ptr, size_type count)
-  { return tiny_mempool::instance()
-      .delloc(ptr, count * sizeof(value_type));
-  }
-};
-
+#ifndef __PAIR_OSTREAM__
+#define __PAIR_OSTREAM__
 template <typename _Tp1, typename _Tp2>
-std::ostream& operator<<(std::ostream& os, 
+std::ostream& operator<<(std::ostream& os,
   const std::pair<_Tp1, _Tp2>& pair) {
   return os << '{' << pair.first << ", " << pair.second << '}';
 }
+#endif
 
 template <typename value_type>
 struct avlnode {
   value_type m_data;  /* data buffer */
   char m_balance_factor; /* leftHeight - rightHeight */
+  avlnode* m_parent;  /* parent, nullptr at the root */
   avlnode* m_lchild;  /* left child */
   avlnode* m_rchild;  /* right child */
+
+  static avlnode* minimum(avlnode* x) {
+    while (x->m_lchild != nullptr)
+      x = x->m_lchild;
+    return x;
+  }
+
+  static avlnode* maximum(avlnode* x) {
+    while (x->m_rchild != nullptr)
+      x = x->m_rchild;
+    return x;
+  }
+
+  // in-order successor, nullptr after the last node.
+  static avlnode* next(avlnode* x) {
+    if (x->m_rchild != nullptr)
+      return minimum(x->m_rchild);
+    avlnode* y = x->m_parent;
+    while (y != nullptr && x == y->m_rchild) {
+      x = y;
+      y = y->m_parent;
+    }
+    return y;
+  }
+
+  static avlnode* prev(avlnode* x) {
+    if (x->m_lchild != nullptr)
+      return maximum(x->m_lchild);
+    avlnode* y = x->m_parent;
+    while (y != nullptr && x == y->m_lchild) {
+      x = y;
+      y = y->m_parent;
+    }
+    return y;
+  }
 };
 
+/**
+ * @brief AVL tree of unique keys.
+ *
+ * Insert and erase are iterative: they find their spot with one
+ * descent and retrace the balance factors up the parent links,
+ * stopping as soon as a subtree's height is unchanged, so nothing
+ * recurses however deep the tree is. Erase relinks nodes instead of
+ * moving values, so iterators to other elements stay valid.
+ */
 template <typename T, typename Alloc=tiny_allocator<T>>
 class avltree {
  protected:
@@ -166,15 +90,85 @@ class avltree {
 
   rbtree_impl m_impl;
 
+ public:
+  template <typename V>
+  class avltree_iterator {
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = T;
+    using difference_type = ptrdiff_t;
+    using pointer = V*;
+    using reference = V&;
+
+    avltree_iterator() : m_node(nullptr), m_tree(nullptr) {}
+
+    avltree_iterator(node* x, const avltree* tree)
+      : m_node(x), m_tree(tree) {}
+
+    template <typename U, typename = typename std::enable_if<
+      std::is_same<const U, V>::value>::type>
+    avltree_iterator(const avltree_iterator<U>& it)
+      : m_node(it.m_node), m_tree(it.m_tree) {}
+
+    reference operator*() const { return m_node->m_data; }
+
+    pointer operator->() const { return &m_node->m_data; }
+
+    avltree_iterator& operator++() {
+      m_node = node::next(m_node);
+      return *this;
+    }
+
+    avltree_iterator operator++(int) {
+      avltree_iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    // end() is nullptr, one step back from it is the maximum.
+    avltree_iterator& operator--() {
+      m_node = m_node == nullptr ? node::maximum(m_tree->m_impl.m_root)
+                                 : node::prev(m_node);
+      return *this;
+    }
+
+    avltree_iterator operator--(int) {
+      avltree_iterator tmp = *this;
+      --*this;
+      return tmp;
+    }
+
+    node* get_node() const { return m_node; }
+
+    friend bool operator==(const avltree_iterator& x,
+                           const avltree_iterator& y)
+    { return x.m_node == y.m_node; }
+
+    friend bool operator!=(const avltree_iterator& x,
+                           const avltree_iterator& y)
+    { return x.m_node != y.m_node; }
+
+   private:
+    template <typename> friend class avltree_iterator;
+
+    node* m_node;
+    const avltree* m_tree;
+  };
+
+  using value_type = T;
+  using iterator = avltree_iterator<const T>;
+  using const_iterator = iterator;
+
  public:
   avltree() : m_impl() {}
 
   avltree(const avltree& tree) {
-    m_impl.m_root = copyfrom(tree.m_impl.m_root);
+    m_impl.m_root = copyfrom(tree.m_impl.m_root, nullptr);
     m_impl.m_node_count = tree.m_impl.m_node_count;
   }
 
   avltree(avltree&& tree) {
+    (allocator_type&)m_impl = std::move((allocator_type&)tree.m_impl);
     m_impl.m_root = tree.m_impl.m_root;
     m_impl.m_node_count = tree.m_impl.m_node_count;
     tree.reset();
@@ -183,48 +177,157 @@ class avltree {
   ~avltree() { clear(); }
 
  public:
-  bool insert(const T& value) {
-    int taller = 0;
-    bool res = insert_avl(m_impl.m_root, value, taller);
-    if (res == true) ++m_impl.m_node_count;
-    return res;
+  bool insert(const T& value)
+  { return insert_unique(value).second; }
+
+  /**
+   * @return the element equal to value and whether it was inserted.
+   */
+  std::pair<iterator, bool> insert_unique(const T& value) {
+    node* parent = nullptr;
+    node* x = m_impl.m_root;
+    bool left = false;
+    while (x != nullptr) {
+      parent = x;
+      if (less(value, x->m_data)) {
+        x = x->m_lchild;
+        left = true;
+      } else if (less(x->m_data, value)) {
+        x = x->m_rchild;
+        left = false;
+      } else {
+        return std::pair<iterator, bool>(iterator(x, this), false);
+      }
+    }
+    node* z = create_node(value);
+    z->m_parent = parent;
+    if (parent == nullptr)
+      m_impl.m_root = z;
+    else if (left)
+      parent->m_lchild = z;
+    else
+      parent->m_rchild = z;
+    ++m_impl.m_node_count;
+    __insert_retrace(z);
+    return std::pair<iterator, bool>(iterator(z, this), true);
+  }
+
+  template <typename K>
+  bool erase(const K& value) {
+    node* z = __find(value);
+    if (z == nullptr)
+      return false;
+    __erase(z);
+    return true;
   }
 
-  bool erase(const T& value) {
-    int shorter = 0;
-    bool res = erase_avl(m_impl.m_root, value, shorter);
-    if (res == true) --m_impl.m_node_count;
-    return res;
+  /**
+   * @return the element after pos.
+   */
+  iterator erase(const_iterator pos) {
+    node* z = pos.get_node();
+    node* next = node::next(z);
+    __erase(z);
+    return iterator(next, this);
+  }
+
+  template <typename K>
+  iterator find(const K& k) const
+  { return iterator(__find(k), this); }
+
+  template <typename K>
+  bool contains(const K& k) const
+  { return __find(k) != nullptr; }
+
+  template <typename K>
+  size_t count(const K& k) const
+  { return contains(k) ? 1 : 0; }
+
+  /**
+   * @brief the first element not less than k.
+   */
+  template <typename K>
+  iterator lower_bound(const K& k) const {
+    node* y = nullptr;
+    node* x = m_impl.m_root;
+    while (x != nullptr) {
+      if (!less(x->m_data, k)) {
+        y = x;
+        x = x->m_lchild;
+      } else {
+        x = x->m_rchild;
+      }
+    }
+    return iterator(y, this);
   }
 
-  size_t size() const 
+  /**
+   * @brief the first element greater than k.
+   */
+  template <typename K>
+  iterator upper_bound(const K& k) const {
+    node* y = nullptr;
+    node* x = m_impl.m_root;
+    while (x != nullptr) {
+      if (less(k, x->m_data)) {
+        y = x;
+        x = x->m_lchild;
+      } else {
+        x = x->m_rchild;
+      }
+    }
+    return iterator(y, this);
+  }
+
+  iterator begin() const {
+    return iterator(m_impl.m_root == nullptr ? nullptr
+                    : node::minimum(m_impl.m_root), this);
+  }
+
+  iterator end() const
+  { return iterator(nullptr, this); }
+
+  size_t size() const
   { return m_impl.m_node_count; }
 
-  bool empty() const 
+  bool empty() const
   { return size() == 0; }
 
   void clear() {
-    if (!empty()) {
-      __destroy(m_impl.m_root);
-      reset();
+    __clear(is_arena_allocator<allocator_type>());
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const avltree& tree) {
+    os << '{';
+    auto it = tree.begin();
+    if (it != tree.end()) {
+      os << *it;
+      for (++it; it != tree.end(); ++it)
+        os << ", " << *it;
     }
+    return os << '}';
   }
 
  // functions for test.
  public:
   bool isavl() const {
     int h;
-    return __isavl(m_impl.m_root, h);
+    return __isavl(m_impl.m_root, nullptr, h);
   }
 
-  bool __isavl(node* rt, int& h) const {
-    if (rt == nullptr) return true;
+  // heights, stored balance factors and parent links all agree.
+  bool __isavl(node* rt, node* parent, int& h) const {
+    if (rt == nullptr) {
+      h = 0;
+      return true;
+    }
     int lh = 0, rh = 0;
-    if (!(__isavl(rt->m_lchild, lh) 
-       && __isavl(rt->m_rchild, rh)))
+    if (rt->m_parent != parent
+        || !__isavl(rt->m_lchild, rt, lh)
+        || !__isavl(rt->m_rchild, rt, rh))
       return false;
-    h = std::max(lh, rh);
-    return abs(lh - rh) <= 1;
+    h = std::max(lh, rh) + 1;
+    return abs(lh - rh) <= 1 && rt->m_balance_factor == lh - rh;
   }
 
   void disp() const {
@@ -234,17 +337,8 @@ class avltree {
   }
 
   void inorder() const {
-    node* p = m_impl.m_root;
-    std::stack<node*> st;
-    while (!st.empty() || p != nullptr) {
-      while (p != nullptr) {
-        st.push(p);
-        p = p->m_lchild;
-      }
-      std::cout << st.top()->m_data << ' ';
-      p = st.top()->m_rchild;
-      st.pop();
-    }
+    for (const T& x : *this)
+      std::cout << x << ' ';
     std::cout << '\n';
   }
 
@@ -269,79 +363,189 @@ class avltree {
     m_impl.m_root = nullptr;
   }
 
-  node* copyfrom(const node* rt) {
+  node* copyfrom(const node* rt, node* parent) {
     if (rt == nullptr) return nullptr;
     node* p = create_node(rt->m_data);
     p->m_balance_factor = rt->m_balance_factor;
-    p->m_lchild = copyfrom((const node*)rt->m_lchild);
-    p->m_rchild = copyfrom((const node*)rt->m_rchild);
+    p->m_parent = parent;
+    p->m_lchild = copyfrom((const node*)rt->m_lchild, p);
+    p->m_rchild = copyfrom((const node*)rt->m_rchild, p);
     return p;
   }
 
-  bool insert_avl(node*& pos, const T&value, int& taller) {
-    if (pos == nullptr) {
-      pos = create_node(value);
-      taller = 1;
-      return true;
+  template <typename K>
+  node* __find(const K& k) const {
+    node* x = m_impl.m_root;
+    while (x != nullptr) {
+      if (less(k, x->m_data))
+        x = x->m_lchild;
+      else if (less(x->m_data, k))
+        x = x->m_rchild;
+      else
+        return x;
     }
-    if (less(value, pos->m_data)) {
-      if (insert_avl(pos->m_lchild, value, taller) == false)
-        return false;
-      if (taller == 1)
-        __insertLprocess(pos, taller);
-    } else if (less(pos->m_data, value)) {
-      if (insert_avl(pos->m_rchild, value, taller) == false)
-        return false;
-      if (taller == 1)
-        __insertRprocess(pos, taller);
-    } else {
-      taller = 0;
-      return false;
+    return nullptr;
+  }
+
+  // z is a new leaf: walk up while the subtree below grew taller.
+  void __insert_retrace(node* z) {
+    for (node* p = z->m_parent; p != nullptr; z = p, p = p->m_parent) {
+      p->m_balance_factor += z == p->m_lchild ? 1 : -1;
+      if (p->m_balance_factor == 0)
+        return;
+      if (p->m_balance_factor == 2 || p->m_balance_factor == -2) {
+        __rebalance(p);
+        return;
+      }
     }
-    return true;
   }
 
-  bool erase_avl(node*& pos, const T&value, int& shorter) {
-    if (pos == nullptr) return false;
-    bool result;
-    if (less(value, pos->m_data)) {
-      result = erase_avl(pos->m_lchild, value, shorter);
-      if (shorter == 1) __eraseLprocess(pos, shorter);
-      return result;
-    } else if (less(pos->m_data, value)) {
-      result = erase_avl(pos->m_rchild, value, shorter);
-      if (shorter == 1) __eraseRprocess(pos, shorter);
-      return result;
-    } else {
-      node* tmp = pos;
-      if (pos->m_lchild == nullptr) {
-        pos = pos->m_rchild;
-        destroy_node(tmp);
-        shorter = 1;
-      } else if (pos->m_rchild == nullptr) {
-        pos = pos->m_lchild;
-        destroy_node(tmp);
-        shorter = 1;
+  void __erase(node* z) {
+    node* p;        // lowest node whose subtree got shorter,
+    bool left;      // and on which side.
+    if (z->m_lchild != nullptr && z->m_rchild != nullptr) {
+      // relink the successor s into z's place.
+      node* s = node::minimum(z->m_rchild);
+      if (s->m_parent == z) {
+        p = s;
+        left = false;
       } else {
-        __eraseAssist(tmp, tmp->m_rchild, shorter);
-        if (shorter == 1)
-          __eraseRprocess(tmp, shorter);
-        pos = tmp;
+        p = s->m_parent;
+        left = true;
+        p->m_lchild = s->m_rchild;
+        if (s->m_rchild != nullptr)
+          s->m_rchild->m_parent = p;
+        s->m_rchild = z->m_rchild;
+        z->m_rchild->m_parent = s;
+      }
+      s->m_lchild = z->m_lchild;
+      z->m_lchild->m_parent = s;
+      s->m_balance_factor = z->m_balance_factor;
+      __replace_child(z, s);
+    } else {
+      node* c = z->m_lchild != nullptr ? z->m_lchild : z->m_rchild;
+      p = z->m_parent;
+      left = p != nullptr && z == p->m_lchild;
+      if (c != nullptr)
+        c->m_parent = p;
+      __replace_child(z, c);
+    }
+    destroy_node(z);
+    --m_impl.m_node_count;
+    __erase_retrace(p, left);
+  }
+
+  // walk up while the subtree below got shorter.
+  void __erase_retrace(node* p, bool left) {
+    while (p != nullptr) {
+      p->m_balance_factor += left ? -1 : 1;
+      if (p->m_balance_factor == 1 || p->m_balance_factor == -1)
+        return;
+      node* parent = p->m_parent;
+      bool pleft = parent != nullptr && p == parent->m_lchild;
+      if (p->m_balance_factor != 0 && !__rebalance(p))
+        return;
+      p = parent;
+      left = pleft;
+    }
+  }
+
+  // put x where z hangs, x may be nullptr.
+  void __replace_child(node* z, node* x) {
+    node* parent = z->m_parent;
+    if (x != nullptr)
+      x->m_parent = parent;
+    if (parent == nullptr)
+      m_impl.m_root = x;
+    else if (z == parent->m_lchild)
+      parent->m_lchild = x;
+    else
+      parent->m_rchild = x;
+  }
+
+  node* __rotate_left(node* x) {
+    node* y = x->m_rchild;
+    x->m_rchild = y->m_lchild;
+    if (y->m_lchild != nullptr)
+      y->m_lchild->m_parent = x;
+    __replace_child(x, y);
+    y->m_lchild = x;
+    x->m_parent = y;
+    return y;
+  }
+
+  node* __rotate_right(node* x) {
+    node* y = x->m_lchild;
+    x->m_lchild = y->m_rchild;
+    if (y->m_rchild != nullptr)
+      y->m_rchild->m_parent = x;
+    __replace_child(x, y);
+    y->m_rchild = x;
+    x->m_parent = y;
+    return y;
+  }
+
+  /**
+   * @brief restore p whose balance factor is +-2 with one or two
+   * rotations.
+   * @return whether the subtree ended up shorter than before the
+   * update that unbalanced it (always, after an insert).
+   */
+  bool __rebalance(node* p) {
+    if (p->m_balance_factor == 2) {
+      node* l = p->m_lchild;
+      if (l->m_balance_factor >= 0) {
+        __rotate_right(p);
+        if (l->m_balance_factor == 0) {
+          p->m_balance_factor = 1;
+          l->m_balance_factor = -1;
+          return false;
+        }
+        p->m_balance_factor = 0;
+        l->m_balance_factor = 0;
+        return true;
       }
+      node* lr = l->m_rchild;
+      __rotate_left(l);
+      __rotate_right(p);
+      p->m_balance_factor = lr->m_balance_factor == 1 ? -1 : 0;
+      l->m_balance_factor = lr->m_balance_factor == -1 ? 1 : 0;
+      lr->m_balance_factor = 0;
       return true;
     }
+    node* r = p->m_rchild;
+    if (r->m_balance_factor <= 0) {
+      __rotate_left(p);
+      if (r->m_balance_factor == 0) {
+        p->m_balance_factor = -1;
+        r->m_balance_factor = 1;
+        return false;
+      }
+      p->m_balance_factor = 0;
+      r->m_balance_factor = 0;
+      return true;
+    }
+    node* rl = r->m_lchild;
+    __rotate_right(r);
+    __rotate_left(p);
+    p->m_balance_factor = rl->m_balance_factor == -1 ? 1 : 0;
+    r->m_balance_factor = rl->m_balance_factor == 1 ? -1 : 0;
+    rl->m_balance_factor = 0;
+    return true;
   }
 
-  node* create_node(const T& x) { 
+  node* create_node(const T& x) {
     node* tmp = m_impl.allocate(1);
     try {
        new (&tmp->m_data) T(x);
-       tmp->m_balance_factor = 0;
-       tmp->m_lchild = nullptr;
-       tmp->m_rchild = nullptr;
     } catch (...) {
       m_impl.deallocate(tmp, 1);
+      throw;
     }
+    tmp->m_balance_factor = 0;
+    tmp->m_parent = nullptr;
+    tmp->m_lchild = nullptr;
+    tmp->m_rchild = nullptr;
     return tmp;
   }
 
@@ -351,11 +555,11 @@ class avltree {
   }
 
   template <typename _Tp>
-  static bool less(const _Tp& x, const _Tp& y) 
+  static bool less(const _Tp& x, const _Tp& y)
   { return x < y; }
 
   template <typename _Tp1, typename _Tp2>
-  static bool less(const std::pair<_Tp1, _Tp2>& x, 
+  static bool less(const std::pair<_Tp1, _Tp2>& x,
             const std::pair<_Tp1, _Tp2>& y) {
     return x.first < y.first;
   }
@@ -370,6 +574,21 @@ class avltree {
     return x < y.first;
   }
 
+  void __clear(std::false_type) {
+    if (!empty()) {
+      __destroy(m_impl.m_root);
+      reset();
+    }
+  }
+
+  // the arena frees every node at once, only non-trivial T need a walk.
+  void __clear(std::true_type) {
+    if (!std::is_trivially_destructible<T>::value && !empty())
+      __destroy(m_impl.m_root);
+    m_impl.release();
+    reset();
+  }
+
   void __destroy(node* pos) {
     while (pos != nullptr) {
       __destroy(pos->m_rchild);
@@ -378,209 +597,4 @@ class avltree {
       pos = tmp;
     }
   }
-
-  void __eraseAssist(node* pos, node*& left, int& shorter) {
-    if (left->m_lchild == nullptr) {
-      pos->m_data = std::move(left->m_data);
-      pos = left;
-      left = left->m_rchild;
-      destroy_node(pos);
-      shorter = 1;
-    } else {
-      __eraseAssist(pos, left->m_lchild, shorter);
-      if (shorter == 1)
-        __eraseLprocess(left, shorter);
-    }
-  }
-
-  void __insertLprocess(node*& pos, int& taller) {
-    node* p1, *p2;
-    if (pos->m_balance_factor == 0) {
-      pos->m_balance_factor = 1;
-      taller = 1;
-    } else if (pos->m_balance_factor == -1) {
-      pos->m_balance_factor = 0;
-      taller = 0;
-    } else {
-      p1 = pos->m_lchild;
-
-      // p1->m_balance_factor must not be 0.
-      if (p1->m_balance_factor == 0) {
-        printf("%d: p1->m_balance is 0.\n", __LINE__);
-        throw;
-      }
-      
-      if (p1->m_balance_factor == 1) { // LL adjust
-        pos->m_lchild = p1->m_rchild;
-        p1->m_rchild = pos;
-        pos->m_balance_factor = 0;
-        p1->m_balance_factor = 0;
-        pos = p1;
-      } else {  // LR adjust
-        p2 = p1->m_rchild;
-        p1->m_rchild = p2->m_lchild;
-        p2->m_lchild = p1;
-        pos->m_lchild = p2->m_rchild;
-        p2->m_rchild = pos;
-
-        if (p2->m_balance_factor == 0) {
-          pos->m_balance_factor = 0;
-          p1->m_balance_factor = 0;
-        } else if (p2->m_balance_factor == 1) {
-          p1->m_balance_factor = 0;
-          pos->m_balance_factor = -1;
-        } else {
-          p1->m_balance_factor = 1;
-          pos->m_balance_factor = 0;
-        }
-
-        pos = p2;
-        pos->m_balance_factor = 0;
-      }
-      taller = 0;
-    }
-  }
-
-  void __insertRprocess(node*& pos, int& taller) {
-    node* p1, *p2;
-    if (pos->m_balance_factor == 0) {
-      pos->m_balance_factor = -1;
-      taller = 1;
-    } else if (pos->m_balance_factor == 1) {
-      pos->m_balance_factor = 0;
-      taller = 0;
-    } else {
-      p1 = pos->m_rchild;
-
-      // p1->m_balance_factor must not be 0.
-      if (p1->m_balance_factor == 0) {
-        printf("%d: p1->m_balance is 0.\n", __LINE__);
-        throw;
-      }
-      
-      if (p1->m_balance_factor == -1) { // RR adjust
-        pos->m_rchild = p1->m_lchild;
-        p1->m_lchild = pos;
-        pos->m_balance_factor = 0;
-        p1->m_balance_factor = 0;
-        pos = p1;
-      } else {  // RL adjust
-        p2 = p1->m_lchild;
-        p1->m_lchild = p2->m_rchild;
-        p2->m_rchild = p1;
-        pos->m_rchild = p2->m_lchild;
-        p2->m_lchild = pos;
-
-        if (p2->m_balance_factor == 0) {
-          pos->m_balance_factor = 0;
-          p1->m_balance_factor = 0;
-        } else if (p2->m_balance_factor == -1) {
-          p1->m_balance_factor = 0;
-          pos->m_balance_factor = 1;
-        } else {
-          p1->m_balance_factor = -1;
-          pos->m_balance_factor = 0;
-        }
-
-        pos = p2;
-        pos->m_balance_factor = 0;
-      }
-      taller = 0;
-    }
-  }
-
-  void __eraseLprocess(node*&pos, int& shorter) {
-    node* p1, *p2;
-    if (pos->m_balance_factor == 1) {
-      pos->m_balance_factor = 0;
-      shorter = 1;
-    } else if (pos->m_balance_factor == 0) {
-      pos->m_balance_factor = -1;
-      shorter = 0;
-    } else {
-      p1 = pos->m_rchild;
-      if (p1->m_balance_factor == 0) {  // RR
-        pos->m_rchild = p1->m_lchild;
-        p1->m_lchild = pos;
-        p1->m_balance_factor = 1;
-        pos->m_balance_factor = -1;
-        pos = p1;
-        shorter = 0;
-      } else if (p1->m_balance_factor == -1) {  // LR
-        pos->m_rchild = p1->m_lchild;
-        p1->m_lchild = pos;
-        pos->m_balance_factor = 0;
-        p1->m_balance_factor = 0;
-        pos = p1;
-        shorter = 1;
-      } else {  // RL
-        p2 = p1->m_lchild;
-        p1->m_lchild = p2->m_rchild;
-        p2->m_rchild = p1;
-        pos->m_rchild = p2->m_lchild;
-        p2->m_lchild = pos;
-        if (p2->m_balance_factor == 0) {
-          pos->m_balance_factor = 0;
-          p1->m_balance_factor = 0;
-        } else if (p2->m_balance_factor == -1) {
-          pos->m_balance_factor = 1;
-          p1->m_balance_factor = 0;
-        } else {
-          pos->m_balance_factor = 0;
-          p1->m_balance_factor = -1;
-        }
-        p2->m_balance_factor = 0;
-        pos = p2;
-        shorter = 1;
-      }
-    }
-  }
-
-  void __eraseRprocess(node*&pos, int& shorter) {
-    node* p1, *p2;
-    if (pos->m_balance_factor == -1) {
-      pos->m_balance_factor = 0;
-      shorter = 1;
-    } else if (pos->m_balance_factor == 0) {
-      pos->m_balance_factor = 1;
-      shorter = 0;
-    } else {
-      p1 = pos->m_lchild;
-      if (p1->m_balance_factor == 0) {  // LL
-        pos->m_lchild = p1->m_rchild;
-        p1->m_rchild = pos;
-        p1->m_balance_factor = -1;
-        pos->m_balance_factor = 1;
-        pos = p1;
-        shorter = 0;
-      } else if (p1->m_balance_factor == 1) { // RL
-        pos->m_lchild = p1->m_rchild;
-        p1->m_rchild = pos;
-        pos->m_balance_factor = 0;
-        p1->m_balance_factor = 0;
-        pos = p1;
-        shorter = 1;
-      } else {  // LR
-        p2 = p1->m_rchild;
-        p1->m_rchild = p2->m_lchild;
-        p2->m_lchild = p1;
-        pos->m_lchild = p2->m_rchild;
-        p2->m_rchild = pos;
-        if (p2->m_balance_factor == 0) {
-          pos->m_balance_factor = 0;
-          p1->m_balance_factor = 0;
-        } else if (p2->m_balance_factor == 1) {
-          pos->m_balance_factor = -1;
-          p1->m_balance_factor = 0;
-        } else {
-          pos->m_balance_factor = 0;
-          p1->m_balance_factor = 1;
-        }
-        p2->m_balance_factor = 0;
-        pos = p2;
-        shorter = 1;
-      }
-    }
-  }
-
-};
\ No newline at end of file
+};
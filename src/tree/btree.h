@@ -0,0 +1,1115 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "../components/mempool.h"
+#include "rbtree.h"
+
+struct btree_identity {
+  template <typename T>
+  static const T& key(const T& x)
+  { return x; }
+};
+
+struct btree_select1st {
+  template <typename P>
+  static const typename P::first_type& key(const P& x)
+  { return x.first; }
+};
+
+/**
+ * @brief B+-tree of unique keys.
+ *
+ * Elements live only in the leaves, which are chained for iteration;
+ * inner nodes hold separator keys and child pointers. Both node kinds
+ * are sized to NodeBytes (a cache-line multiple) and come from the
+ * pool, so a lookup touches about log_B(n) nodes instead of log2(n).
+ *
+ * @attention unlike rbtree, insert and erase move elements between
+ * slots: they invalidate every iterator and element pointer.
+ */
+template <typename Key, typename T, typename KeyOfValue,
+          typename Alloc=tiny_allocator<T>, size_t NodeBytes=256>
+class btree {
+ protected:
+  template <typename _Tp, typename _Up>
+  struct alloc_rebind {};
+
+  template <template <typename, typename...> class _Template,
+            typename _Up, typename _Tp, typename... _Types>
+  struct alloc_rebind<_Template<_Tp, _Types...>, _Up>
+  { using type = _Template<_Up, _Types...>; };
+
+  struct node {
+    uint16_t m_count;
+    bool m_leaf;
+  };
+
+  // one spare slot, so a node may overflow by one before it is split.
+  static constexpr int LEAFCAP = std::max<int>(
+    4, (NodeBytes - 3 * sizeof(void*)) / sizeof(T));
+  static constexpr int INNERCAP = std::max<int>(
+    4, (NodeBytes - 2 * sizeof(void*)) / (sizeof(Key) + sizeof(void*)));
+
+ public:
+  static constexpr int LEAFMAX = LEAFCAP - 1;
+  static constexpr int INNERMAX = INNERCAP - 1;
+
+ protected:
+  static constexpr int LEAFMIN = LEAFMAX / 2;
+  static constexpr int INNERMIN = INNERMAX / 2;
+  static constexpr int MAXDEPTH = 64;
+
+  struct leaf : node {
+    leaf* m_prev;
+    leaf* m_next;
+    alignas(T) unsigned char m_raw[LEAFCAP * sizeof(T)];
+
+    T* slots() { return reinterpret_cast<T*>(m_raw); }
+  };
+
+  struct inner : node {
+    node* m_child[INNERCAP + 1];
+    alignas(Key) unsigned char m_raw[INNERCAP * sizeof(Key)];
+
+    Key* keys() { return reinterpret_cast<Key*>(m_raw); }
+  };
+
+  using leaf_allocator = typename alloc_rebind<Alloc, leaf>::type;
+  using inner_allocator = typename alloc_rebind<Alloc, inner>::type;
+
+  struct btree_impl : public leaf_allocator, public inner_allocator
+  { node* m_root;
+    leaf* m_first;
+    leaf* m_last;
+    size_t m_node_count;
+  };
+
+  btree_impl m_impl;
+
+ public:
+  template <typename V>
+  class basic_iterator {
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = T;
+    using difference_type = ptrdiff_t;
+    using pointer = V*;
+    using reference = V&;
+
+    basic_iterator() : m_leaf(nullptr), m_pos(0) {}
+
+    basic_iterator(leaf* x, int pos) : m_leaf(x), m_pos(pos) {}
+
+    template <typename U, typename = typename std::enable_if<
+      std::is_same<const U, V>::value>::type>
+    basic_iterator(const basic_iterator<U>& it)
+      : m_leaf(it.m_leaf), m_pos(it.m_pos) {}
+
+    reference operator*() const { return m_leaf->slots()[m_pos]; }
+
+    pointer operator->() const { return &m_leaf->slots()[m_pos]; }
+
+    basic_iterator& operator++() {
+      if (++m_pos == m_leaf->m_count && m_leaf->m_next != nullptr) {
+        m_leaf = m_leaf->m_next;
+        m_pos = 0;
+      }
+      return *this;
+    }
+
+    basic_iterator operator++(int) {
+      basic_iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    basic_iterator& operator--() {
+      if (m_pos == 0) {
+        m_leaf = m_leaf->m_prev;
+        m_pos = m_leaf->m_count;
+      }
+      --m_pos;
+      return *this;
+    }
+
+    basic_iterator operator--(int) {
+      basic_iterator tmp = *this;
+      --*this;
+      return tmp;
+    }
+
+    friend bool operator==(const basic_iterator& x, const basic_iterator& y)
+    { return x.m_leaf == y.m_leaf && x.m_pos == y.m_pos; }
+
+    friend bool operator!=(const basic_iterator& x, const basic_iterator& y)
+    { return !(x == y); }
+
+   private:
+    template <typename> friend class basic_iterator;
+    friend class btree;
+
+    leaf* m_leaf;
+    int m_pos;
+  };
+
+  using value_type = T;
+  using key_type = Key;
+  using iterator = basic_iterator<T>;
+  using const_iterator = basic_iterator<const T>;
+
+ public:
+  btree() : m_impl() { reset(); }
+
+  btree(const btree& tree) : m_impl() {
+    reset();
+    __build(tree.begin(), tree.size());
+  }
+
+  btree(btree&& tree) : m_impl() {
+    (leaf_allocator&)m_impl = std::move((leaf_allocator&)tree.m_impl);
+    (inner_allocator&)m_impl = std::move((inner_allocator&)tree.m_impl);
+    m_impl.m_root = tree.m_impl.m_root;
+    m_impl.m_first = tree.m_impl.m_first;
+    m_impl.m_last = tree.m_impl.m_last;
+    m_impl.m_node_count = tree.m_impl.m_node_count;
+    tree.reset();
+  }
+
+  ~btree() { clear(); }
+
+  btree& operator=(const btree& tree) {
+    if (this != &tree) {
+      clear();
+      __build(tree.begin(), tree.size());
+    }
+    return *this;
+  }
+
+  btree& operator=(btree&& tree) {
+    if (this != &tree) {
+      clear();
+      std::swap(m_impl.m_root, tree.m_impl.m_root);
+      std::swap(m_impl.m_first, tree.m_impl.m_first);
+      std::swap(m_impl.m_last, tree.m_impl.m_last);
+      std::swap(m_impl.m_node_count, tree.m_impl.m_node_count);
+    }
+    return *this;
+  }
+
+ public:
+  iterator begin()
+  { return iterator(m_impl.m_first, 0); }
+
+  iterator end()
+  { return __end(); }
+
+  const_iterator begin() const
+  { return const_iterator(m_impl.m_first, 0); }
+
+  const_iterator end() const
+  { return __end(); }
+
+  size_t size() const
+  { return m_impl.m_node_count; }
+
+  bool empty() const
+  { return size() == 0; }
+
+  void clear() {
+    if (m_impl.m_root != nullptr)
+      __destroy(m_impl.m_root);
+    reset();
+  }
+
+  /**
+   * @brief O(n) when [first, last) is strictly ascending,
+   * O(n log n) otherwise.
+   */
+  template <typename ForwardIt>
+  void assign_unique(ForwardIt first, ForwardIt last) {
+    clear();
+    if (first == last) return;
+    size_t n = 1;
+    for (ForwardIt prev = first, it = std::next(first); it != last;
+         prev = it++, ++n) {
+      if (!less(key(*prev), key(*it))) {
+        for (; first != last; ++first)
+          insert_unique(*first);
+        return;
+      }
+    }
+    __build(first, n);
+  }
+
+  std::pair<iterator, bool> insert_unique(const T& value)
+  { return try_emplace_unique(key(value), value); }
+
+  std::pair<iterator, bool> insert_unique(T&& value)
+  { return try_emplace_unique(key(value), std::move(value)); }
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace_unique(Args&&... args) {
+    T tmp(std::forward<Args>(args)...);
+    return insert_unique(std::move(tmp));
+  }
+
+  /**
+   * @brief construct T(args...) in place unless k is present, in which
+   * case args are not touched.
+   */
+  template <typename K, typename... Args>
+  std::pair<iterator, bool> try_emplace_unique(const K& k, Args&&... args) {
+    if (m_impl.m_root == nullptr) {
+      leaf* x = create_leaf();
+      try {
+        new (x->slots()) T(std::forward<Args>(args)...);
+      } catch (...) {
+        destroy_leaf(x);
+        throw;
+      }
+      x->m_count = 1;
+      m_impl.m_root = m_impl.m_first = m_impl.m_last = x;
+      m_impl.m_node_count = 1;
+      return std::pair<iterator, bool>(begin(), true);
+    }
+    path_type path;
+    leaf* x = __descend(k, path);
+    int pos = __lower(x, k);
+    if (pos < x->m_count && !less(k, key(x->slots()[pos])))
+      return std::pair<iterator, bool>(__make_iter(x, pos), false);
+    __move_up(x->slots(), x->m_count, pos);
+    try {
+      new (x->slots() + pos) T(std::forward<Args>(args)...);
+    } catch (...) {
+      __move_down(x->slots(), x->m_count + 1, pos);
+      throw;
+    }
+    ++x->m_count;
+    ++m_impl.m_node_count;
+    if (x->m_count <= LEAFMAX)
+      return std::pair<iterator, bool>(__make_iter(x, pos), true);
+    leaf* r = __split_leaf(x, pos, path);
+    if (pos >= x->m_count)
+      return std::pair<iterator, bool>(
+        __make_iter(r, pos - x->m_count), true);
+    return std::pair<iterator, bool>(__make_iter(x, pos), true);
+  }
+
+  template <typename K>
+  size_t erase(const K& k) {
+    if (m_impl.m_root == nullptr)
+      return 0;
+    path_type path;
+    leaf* x = __descend(k, path);
+    int pos = __lower(x, k);
+    if (pos == x->m_count || less(k, key(x->slots()[pos])))
+      return 0;
+    x->slots()[pos].~T();
+    __move_down(x->slots(), x->m_count, pos);
+    --x->m_count;
+    --m_impl.m_node_count;
+    __rebalance_leaf(x, path);
+    return 1;
+  }
+
+  template <typename K>
+  iterator lower_bound(const K& k) {
+    if (m_impl.m_root == nullptr)
+      return end();
+    path_type path;
+    leaf* x = __descend(k, path);
+    return __make_iter(x, __lower(x, k));
+  }
+
+  template <typename K>
+  const_iterator lower_bound(const K& k) const
+  { return const_cast<btree*>(this)->lower_bound(k); }
+
+  template <typename K>
+  iterator find(const K& k) {
+    iterator it = lower_bound(k);
+    if (it == end() || less(k, key(*it)))
+      return end();
+    return it;
+  }
+
+  template <typename K>
+  const_iterator find(const K& k) const
+  { return const_cast<btree*>(this)->find(k); }
+
+  template <typename K>
+  bool contains(const K& k) const
+  { return find(k) != end(); }
+
+  /**
+   * @brief print one line per level, nodes as [k1 k2 ...].
+   */
+  void disp() const {
+    std::vector<node*> level;
+    if (m_impl.m_root != nullptr)
+      level.push_back(m_impl.m_root);
+    while (!level.empty()) {
+      std::vector<node*> next;
+      for (node* x : level) {
+        std::cout << '[';
+        if (x->m_leaf) {
+          leaf* l = static_cast<leaf*>(x);
+          for (int i = 0; i < l->m_count; i++)
+            std::cout << (i ? " " : "") << key(l->slots()[i]);
+        } else {
+          inner* in = static_cast<inner*>(x);
+          for (int i = 0; i < in->m_count; i++)
+            std::cout << (i ? " " : "") << in->keys()[i];
+          for (int i = 0; i <= in->m_count; i++)
+            next.push_back(in->m_child[i]);
+        }
+        std::cout << "] ";
+      }
+      std::cout << std::endl;
+      level.swap(next);
+    }
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const btree& tree) {
+    os << '{';
+    auto it = tree.begin();
+    if (it != tree.end()) {
+      os << *it;
+      for (++it; it != tree.end(); ++it)
+        os << ", " << *it;
+    }
+    return os << '}';
+  }
+
+ protected:
+  struct path_type {
+    inner* m_node[MAXDEPTH];
+    int m_index[MAXDEPTH];
+    int m_depth;
+  };
+
+  static const Key& key(const T& x)
+  { return KeyOfValue::key(x); }
+
+  template <typename U, typename V>
+  static bool less(const U& x, const V& y)
+  { return x < y; }
+
+  void reset() {
+    m_impl.m_root = nullptr;
+    m_impl.m_first = nullptr;
+    m_impl.m_last = nullptr;
+    m_impl.m_node_count = 0;
+  }
+
+  iterator __end() const {
+    leaf* x = m_impl.m_last;
+    return x == nullptr ? iterator() : iterator(x, x->m_count);
+  }
+
+  // the slot one past a leaf is the first slot of the next one.
+  static iterator __make_iter(leaf* x, int pos) {
+    if (pos == x->m_count && x->m_next != nullptr)
+      return iterator(x->m_next, 0);
+    return iterator(x, pos);
+  }
+
+  leaf* create_leaf() {
+    leaf* x = m_impl.leaf_allocator::allocate(1);
+    x->m_count = 0;
+    x->m_leaf = true;
+    x->m_prev = x->m_next = nullptr;
+    return x;
+  }
+
+  inner* create_inner() {
+    inner* x = m_impl.inner_allocator::allocate(1);
+    x->m_count = 0;
+    x->m_leaf = false;
+    return x;
+  }
+
+  void destroy_leaf(leaf* x)
+  { m_impl.leaf_allocator::deallocate(x, 1); }
+
+  void destroy_inner(inner* x)
+  { m_impl.inner_allocator::deallocate(x, 1); }
+
+  void __destroy(node* x) {
+    if (x->m_leaf) {
+      leaf* l = static_cast<leaf*>(x);
+      for (int i = 0; i < l->m_count; i++)
+        l->slots()[i].~T();
+      destroy_leaf(l);
+    } else {
+      inner* in = static_cast<inner*>(x);
+      for (int i = 0; i < in->m_count; i++)
+        in->keys()[i].~Key();
+      for (int i = 0; i <= in->m_count; i++)
+        __destroy(in->m_child[i]);
+      destroy_inner(in);
+    }
+  }
+
+  // open a hole at pos in a[0, n), closing it is the reverse.
+  template <typename U>
+  static void __move_up(U* a, int n, int pos) {
+    for (int j = n; j > pos; --j) {
+      new (a + j) U(std::move(a[j - 1]));
+      a[j - 1].~U();
+    }
+  }
+
+  template <typename U>
+  static void __move_down(U* a, int n, int pos) {
+    for (int j = pos; j + 1 < n; ++j) {
+      new (a + j) U(std::move(a[j + 1]));
+      a[j + 1].~U();
+    }
+  }
+
+  template <typename U>
+  static void __relocate(U* first, int n, U* dest) {
+    for (int j = 0; j < n; ++j) {
+      new (dest + j) U(std::move(first[j]));
+      first[j].~U();
+    }
+  }
+
+  static void __child_up(inner* x, int pos) {
+    std::copy_backward(x->m_child + pos, x->m_child + x->m_count + 1,
+                       x->m_child + x->m_count + 2);
+  }
+
+  static void __child_down(inner* x, int pos) {
+    std::copy(x->m_child + pos + 1, x->m_child + x->m_count + 1,
+              x->m_child + pos);
+  }
+
+  template <typename K>
+  static int __lower(leaf* x, const K& k) {
+    int lo = 0, hi = x->m_count;
+    T* s = x->slots();
+    while (lo < hi) {
+      int mid = (lo + hi) >> 1;
+      if (less(key(s[mid]), k))
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo;
+  }
+
+  // child i holds the keys in [keys[i - 1], keys[i]).
+  template <typename K>
+  static int __upper(inner* x, const K& k) {
+    int lo = 0, hi = x->m_count;
+    Key* s = x->keys();
+    while (lo < hi) {
+      int mid = (lo + hi) >> 1;
+      if (less(k, s[mid]))
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+    return lo;
+  }
+
+  template <typename K>
+  leaf* __descend(const K& k, path_type& path) const {
+    node* x = m_impl.m_root;
+    path.m_depth = 0;
+    while (!x->m_leaf) {
+      inner* in = static_cast<inner*>(x);
+      int i = __upper(in, k);
+      path.m_node[path.m_depth] = in;
+      path.m_index[path.m_depth++] = i;
+      x = in->m_child[i];
+    }
+    return static_cast<leaf*>(x);
+  }
+
+  /**
+   * @brief split an overflowing leaf in two and push the separator up
+   * the path, splitting inner nodes as needed. An append to the last
+   * leaf keeps it full, so ascending inserts pack the leaves.
+   * @return the new right half.
+   */
+  leaf* __split_leaf(leaf* x, int pos, path_type& path) {
+    leaf* r = create_leaf();
+    int h = (x->m_count + 1) / 2;
+    if (x->m_next == nullptr && pos == x->m_count - 1)
+      h = x->m_count - 1;
+    __relocate(x->slots() + h, x->m_count - h, r->slots());
+    r->m_count = x->m_count - h;
+    x->m_count = h;
+    r->m_prev = x;
+    r->m_next = x->m_next;
+    if (x->m_next != nullptr)
+      x->m_next->m_prev = r;
+    else
+      m_impl.m_last = r;
+    x->m_next = r;
+
+    Key sep(key(r->slots()[0]));
+    node* right = r;
+    for (int d = path.m_depth - 1; d >= 0; --d) {
+      inner* p = path.m_node[d];
+      int i = path.m_index[d];
+      __move_up(p->keys(), p->m_count, i);
+      new (p->keys() + i) Key(std::move(sep));
+      __child_up(p, i + 1);
+      p->m_child[i + 1] = right;
+      ++p->m_count;
+      if (p->m_count <= INNERMAX)
+        return r;
+      inner* q = create_inner();
+      h = p->m_count / 2;
+      q->m_count = p->m_count - h - 1;
+      __relocate(p->keys() + h + 1, q->m_count, q->keys());
+      std::copy(p->m_child + h + 1, p->m_child + p->m_count + 1,
+                q->m_child);
+      sep.~Key();
+      new (&sep) Key(std::move(p->keys()[h]));
+      p->keys()[h].~Key();
+      p->m_count = h;
+      right = q;
+    }
+    inner* rt = create_inner();
+    new (rt->keys()) Key(std::move(sep));
+    rt->m_child[0] = m_impl.m_root;
+    rt->m_child[1] = right;
+    rt->m_count = 1;
+    m_impl.m_root = rt;
+    return r;
+  }
+
+  // drop keys[j] and m_child[j + 1] from x.
+  void __remove_from(inner* x, int j) {
+    x->keys()[j].~Key();
+    __close_gap(x, j);
+  }
+
+  // same, with keys[j] already moved out.
+  static void __close_gap(inner* x, int j) {
+    __move_down(x->keys(), x->m_count, j);
+    __child_down(x, j + 1);
+    --x->m_count;
+  }
+
+  void __merge_leaves(leaf* a, leaf* b) {
+    __relocate(b->slots(), b->m_count, a->slots() + a->m_count);
+    a->m_count += b->m_count;
+    a->m_next = b->m_next;
+    if (b->m_next != nullptr)
+      b->m_next->m_prev = a;
+    else
+      m_impl.m_last = a;
+    destroy_leaf(b);
+  }
+
+  void __rebalance_leaf(leaf* x, path_type& path) {
+    if (path.m_depth == 0) {
+      if (x->m_count == 0) {
+        destroy_leaf(x);
+        reset();
+      }
+      return;
+    }
+    if (x->m_count >= LEAFMIN)
+      return;
+    inner* p = path.m_node[path.m_depth - 1];
+    int i = path.m_index[path.m_depth - 1];
+    leaf* l = i > 0 ? static_cast<leaf*>(p->m_child[i - 1]) : nullptr;
+    leaf* r = i < p->m_count ? static_cast<leaf*>(p->m_child[i + 1])
+                             : nullptr;
+    if (l != nullptr && l->m_count > LEAFMIN) {
+      __move_up(x->slots(), x->m_count, 0);
+      __relocate(l->slots() + l->m_count - 1, 1, x->slots());
+      --l->m_count;
+      ++x->m_count;
+      p->keys()[i - 1] = key(x->slots()[0]);
+      return;
+    }
+    if (r != nullptr && r->m_count > LEAFMIN) {
+      __relocate(r->slots(), 1, x->slots() + x->m_count);
+      __move_down(r->slots(), r->m_count, 0);
+      --r->m_count;
+      ++x->m_count;
+      p->keys()[i] = key(r->slots()[0]);
+      return;
+    }
+    if (l != nullptr) {
+      __merge_leaves(l, x);
+      __remove_from(p, i - 1);
+    } else {
+      __merge_leaves(x, r);
+      __remove_from(p, i);
+    }
+    __rebalance_inner(path);
+  }
+
+  // path.m_node[path.m_depth - 1] just lost a key.
+  void __rebalance_inner(path_type& path) {
+    for (int d = path.m_depth - 1; d >= 0; --d) {
+      inner* x = path.m_node[d];
+      if (d == 0) {
+        if (x->m_count == 0) {
+          m_impl.m_root = x->m_child[0];
+          destroy_inner(x);
+        }
+        return;
+      }
+      if (x->m_count >= INNERMIN)
+        return;
+      inner* p = path.m_node[d - 1];
+      int i = path.m_index[d - 1];
+      inner* l = i > 0 ? static_cast<inner*>(p->m_child[i - 1]) : nullptr;
+      inner* r = i < p->m_count ? static_cast<inner*>(p->m_child[i + 1])
+                                : nullptr;
+      if (l != nullptr && l->m_count > INNERMIN) {
+        __move_up(x->keys(), x->m_count, 0);
+        __relocate(p->keys() + i - 1, 1, x->keys());
+        __relocate(l->keys() + l->m_count - 1, 1, p->keys() + i - 1);
+        __child_up(x, 0);
+        x->m_child[0] = l->m_child[l->m_count];
+        --l->m_count;
+        ++x->m_count;
+        return;
+      }
+      if (r != nullptr && r->m_count > INNERMIN) {
+        __relocate(p->keys() + i, 1, x->keys() + x->m_count);
+        __relocate(r->keys(), 1, p->keys() + i);
+        __move_down(r->keys(), r->m_count, 0);
+        x->m_child[x->m_count + 1] = r->m_child[0];
+        __child_down(r, 0);
+        --r->m_count;
+        ++x->m_count;
+        return;
+      }
+      if (l != nullptr)
+        __merge_inner(l, x, p, i - 1);
+      else
+        __merge_inner(x, r, p, i);
+    }
+  }
+
+  // a, keys[j] of p and b become a; b is freed.
+  void __merge_inner(inner* a, inner* b, inner* p, int j) {
+    __relocate(p->keys() + j, 1, a->keys() + a->m_count);
+    __relocate(b->keys(), b->m_count, a->keys() + a->m_count + 1);
+    std::copy(b->m_child, b->m_child + b->m_count + 1,
+              a->m_child + a->m_count + 1);
+    a->m_count += b->m_count + 1;
+    destroy_inner(b);
+    __close_gap(p, j);
+  }
+
+  /**
+   * @brief bottom-up bulk load of n strictly ascending elements, every
+   * node filled to about the same count. Expects an empty tree.
+   */
+  template <typename InputIt>
+  void __build(InputIt first, size_t n) {
+    if (n == 0) return;
+    std::vector<node*> level;
+    std::vector<inner*> inners;
+    std::vector<Key> mins;
+    size_t nleaf = (n + LEAFMAX - 1) / LEAFMAX;
+    level.reserve(nleaf);
+    mins.reserve(nleaf);
+    leaf* prev = nullptr;
+    try {
+      for (size_t i = 0; i < nleaf; i++) {
+        leaf* x = create_leaf();
+        int cnt = n / nleaf + (i < n % nleaf ? 1 : 0);
+        x->m_prev = prev;
+        if (prev != nullptr)
+          prev->m_next = x;
+        else
+          m_impl.m_first = x;
+        prev = x;
+        for (; x->m_count < cnt; ++first) {
+          new (x->slots() + x->m_count) T(*first);
+          ++x->m_count;
+          ++m_impl.m_node_count;
+        }
+        level.push_back(x);
+        mins.push_back(key(x->slots()[0]));
+      }
+      m_impl.m_last = prev;
+      while (level.size() > 1) {
+        size_t nin = (level.size() + INNERMAX) / (INNERMAX + 1);
+        std::vector<node*> up;
+        std::vector<Key> upmins;
+        size_t c = 0;
+        for (size_t i = 0; i < nin; i++) {
+          inner* x = create_inner();
+          inners.push_back(x);
+          size_t cnt = level.size() / nin + (i < level.size() % nin ? 1 : 0);
+          up.push_back(x);
+          upmins.push_back(mins[c]);
+          x->m_child[0] = level[c++];
+          for (size_t j = 1; j < cnt; j++, c++) {
+            new (x->keys() + x->m_count) Key(mins[c]);
+            x->m_child[++x->m_count] = level[c];
+          }
+        }
+        level.swap(up);
+        mins.swap(upmins);
+      }
+    } catch (...) {
+      // the leaves are chained; inner nodes are freed one by one.
+      for (leaf* x = m_impl.m_first; x != nullptr; ) {
+        leaf* next = x->m_next;
+        __destroy(x);
+        x = next;
+      }
+      for (inner* x : inners) {
+        for (int i = 0; i < x->m_count; i++)
+          x->keys()[i].~Key();
+        destroy_inner(x);
+      }
+      reset();
+      throw;
+    }
+    m_impl.m_root = level[0];
+  }
+};
+
+template <typename Key, typename T, typename KeyOfValue, typename Alloc,
+          size_t NodeBytes>
+constexpr int btree<Key, T, KeyOfValue, Alloc, NodeBytes>::LEAFMAX;
+
+template <typename Key, typename T, typename KeyOfValue, typename Alloc,
+          size_t NodeBytes>
+constexpr int btree<Key, T, KeyOfValue, Alloc, NodeBytes>::INNERMAX;
+
+/**
+ * @brief drop-in for set backed by a btree. Node handles are not
+ * offered: elements do not live in nodes of their own.
+ */
+template <typename T, size_t NodeBytes=256>
+class btree_set {
+ protected:
+  using tree_type = btree<T, T, btree_identity, tiny_allocator<T>, NodeBytes>;
+
+  tree_type m_tree;
+
+ public:
+  btree_set() = default;
+
+  btree_set(std::initializer_list<T> l) : btree_set(l.begin(), l.end()) {}
+
+  /**
+   * @brief O(n) when [first, last) is strictly ascending,
+   * O(n log n) otherwise.
+   */
+  template <typename ForwardIt>
+  btree_set(ForwardIt first, ForwardIt last) : m_tree()
+  { m_tree.assign_unique(first, last); }
+
+  using iterator = typename tree_type::const_iterator;
+  using const_iterator = iterator;
+
+  iterator begin() const
+  { return m_tree.begin(); }
+
+  iterator end() const
+  { return m_tree.end(); }
+
+  bool insert(const T& x)
+  { return m_tree.insert_unique(x).second; }
+
+  bool insert(T&& x)
+  { return m_tree.insert_unique(std::move(x)).second; }
+
+  /**
+   * @brief the hint is not needed: a descent is a handful of nodes.
+   */
+  iterator insert(iterator, const T& x)
+  { return m_tree.insert_unique(x).first; }
+
+  iterator insert(iterator, T&& x)
+  { return m_tree.insert_unique(std::move(x)).first; }
+
+  template <typename... Args>
+  bool emplace(Args&&... args)
+  { return m_tree.emplace_unique(std::forward<Args>(args)...).second; }
+
+  template <typename... Args>
+  iterator emplace_hint(iterator, Args&&... args)
+  { return m_tree.emplace_unique(std::forward<Args>(args)...).first; }
+
+  bool erase(const T& x)
+  { return m_tree.erase(x) != 0; }
+
+  template <typename U>
+  iterator find(const U& x) const
+  { return m_tree.find(x); }
+
+  /**
+   * @brief union / intersection / difference as one linear merge
+   * followed by a bulk load, O(n + m). The pool is accepted for
+   * compatibility with set and not used. An rvalue x is left empty
+   * unless it is this set.
+   */
+  void set_union(const btree_set& x, ThreadPool* = nullptr) {
+    std::vector<T> out;
+    out.reserve(size() + x.size());
+    std::set_union(begin(), end(), x.begin(), x.end(),
+                   std::back_inserter(out));
+    __assign(out);
+  }
+
+  void set_union(btree_set&& x, ThreadPool* pool = nullptr) {
+    set_union(x, pool);
+    if (&x != this)
+      x.clear();
+  }
+
+  void set_intersection(const btree_set& x, ThreadPool* = nullptr) {
+    std::vector<T> out;
+    out.reserve(std::min(size(), x.size()));
+    std::set_intersection(begin(), end(), x.begin(), x.end(),
+                          std::back_inserter(out));
+    __assign(out);
+  }
+
+  void set_intersection(btree_set&& x, ThreadPool* pool = nullptr) {
+    set_intersection(x, pool);
+    if (&x != this)
+      x.clear();
+  }
+
+  void set_difference(const btree_set& x, ThreadPool* = nullptr) {
+    std::vector<T> out;
+    out.reserve(size());
+    std::set_difference(begin(), end(), x.begin(), x.end(),
+                        std::back_inserter(out));
+    __assign(out);
+  }
+
+  void set_difference(btree_set&& x, ThreadPool* pool = nullptr) {
+    set_difference(x, pool);
+    if (&x != this)
+      x.clear();
+  }
+
+  /**
+   * @brief move the elements of src not in this set over; the others
+   * stay in src. O(n + m).
+   */
+  void merge(btree_set& src, ThreadPool* = nullptr) {
+    std::vector<T> out, rest;
+    out.reserve(size() + src.size());
+    auto a = m_tree.begin();
+    auto last = m_tree.end();
+    for (auto b = src.m_tree.begin(); b != src.m_tree.end(); ++b) {
+      for (; a != last && *a < *b; ++a)
+        out.push_back(std::move(*a));
+      if (a != last && !(*b < *a))
+        rest.push_back(std::move(*b));
+      else
+        out.push_back(std::move(*b));
+    }
+    for (; a != last; ++a)
+      out.push_back(std::move(*a));
+    __assign(out);
+    src.__assign(rest);
+  }
+
+  template <typename U>
+  bool contains(const U& x) const
+  { return m_tree.contains(x); }
+
+  template <typename U>
+  size_t count(const U& x) const
+  { return m_tree.contains(x) ? 1 : 0; }
+
+  bool empty() const
+  { return m_tree.empty(); }
+
+  size_t size() const
+  { return m_tree.size(); }
+
+  void clear()
+  { m_tree.clear(); }
+
+  void disp() const
+  { m_tree.disp(); }
+
+  friend std::ostream& operator<<(std::ostream& os, const btree_set& x)
+  { return os << x.m_tree; }
+
+ protected:
+  void __assign(std::vector<T>& sorted) {
+    m_tree.assign_unique(std::make_move_iterator(sorted.begin()),
+                         std::make_move_iterator(sorted.end()));
+  }
+};
+
+/**
+ * @brief drop-in for map backed by a btree.
+ */
+template <typename K, typename V, size_t NodeBytes=256>
+class btree_map {
+ protected:
+  using tree_type = btree<K, std::pair<K, V>, btree_select1st,
+                          tiny_allocator<std::pair<K, V>>, NodeBytes>;
+
+  tree_type m_tree;
+
+ public:
+  btree_map() = default;
+
+  btree_map(std::initializer_list<std::pair<K, V>> l)
+    : btree_map(l.begin(), l.end()) {}
+
+  /**
+   * @brief O(n) when the keys of [first, last) are strictly ascending,
+   * O(n log n) otherwise.
+   */
+  template <typename ForwardIt>
+  btree_map(ForwardIt first, ForwardIt last) : m_tree()
+  { m_tree.assign_unique(first, last); }
+
+  using iterator = typename tree_type::iterator;
+  using const_iterator = typename tree_type::const_iterator;
+
+  iterator begin()
+  { return m_tree.begin(); }
+
+  iterator end()
+  { return m_tree.end(); }
+
+  const_iterator begin() const
+  { return m_tree.begin(); }
+
+  const_iterator end() const
+  { return m_tree.end(); }
+
+  bool insert(const std::pair<K, V>& x)
+  { return m_tree.insert_unique(x).second; }
+
+  bool insert(std::pair<K, V>&& x)
+  { return m_tree.insert_unique(std::move(x)).second; }
+
+  iterator insert(const_iterator, const std::pair<K, V>& x)
+  { return m_tree.insert_unique(x).first; }
+
+  iterator insert(const_iterator, std::pair<K, V>&& x)
+  { return m_tree.insert_unique(std::move(x)).first; }
+
+  template <typename... Args>
+  bool emplace(Args&&... args)
+  { return m_tree.emplace_unique(std::forward<Args>(args)...).second; }
+
+  template <typename... Args>
+  iterator emplace_hint(const_iterator, Args&&... args)
+  { return m_tree.emplace_unique(std::forward<Args>(args)...).first; }
+
+  bool erase(const std::pair<K, V>& x)
+  { return m_tree.erase(x.first) != 0; }
+
+  template <typename U>
+  iterator find(const U& key)
+  { return m_tree.find(key); }
+
+  template <typename U>
+  const_iterator find(const U& key) const
+  { return m_tree.find(key); }
+
+  template <typename U>
+  bool contains(const U& key) const
+  { return m_tree.contains(key); }
+
+  /**
+   * @brief move the entries of src whose keys are not in this map
+   * over; the others stay in src. O(n + m).
+   */
+  void merge(btree_map& src, ThreadPool* = nullptr) {
+    std::vector<std::pair<K, V>> out, rest;
+    out.reserve(size() + src.size());
+    auto a = begin();
+    auto last = end();
+    for (auto b = src.begin(); b != src.end(); ++b) {
+      for (; a != last && a->first < b->first; ++a)
+        out.push_back(std::move(*a));
+      if (a != last && !(b->first < a->first))
+        rest.push_back(std::move(*b));
+      else
+        out.push_back(std::move(*b));
+    }
+    for (; a != last; ++a)
+      out.push_back(std::move(*a));
+    m_tree.assign_unique(std::make_move_iterator(out.begin()),
+                         std::make_move_iterator(out.end()));
+    src.m_tree.assign_unique(std::make_move_iterator(rest.begin()),
+                             std::make_move_iterator(rest.end()));
+  }
+
+  template <typename U>
+  size_t count(const U& key) const
+  { return m_tree.contains(key) ? 1 : 0; }
+
+  /**
+   * @brief insert {key, V(args...)} unless key is present, in which
+   * case args are not touched (so they may still be moved from later).
+   */
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+    return m_tree.try_emplace_unique(key, std::piecewise_construct,
+      std::forward_as_tuple(key),
+      std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+    return m_tree.try_emplace_unique(key, std::piecewise_construct,
+      std::forward_as_tuple(std::move(key)),
+      std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  bool empty() const
+  { return m_tree.empty(); }
+
+  size_t size() const
+  { return m_tree.size(); }
+
+  void clear()
+  { m_tree.clear(); }
+
+  void disp() const
+  { m_tree.disp(); }
+
+  friend std::ostream& operator<<(std::ostream& os, const btree_map& x)
+  { return os << x.m_tree; }
+
+  V& operator[](const K& key)
+  { return try_emplace(key).first->second; }
+
+  V& operator[](K&& key)
+  { return try_emplace(std::move(key)).first->second; }
+
+  const V& operator[](const K& key) const {
+    auto it = m_tree.find(key);
+    if (it == m_tree.end()) {
+      std::ostringstream msg;
+      msg << "KeyError: " << key;
+      throw std::logic_error(msg.str());
+    }
+    else
+      return it->second;
+  }
+
+};
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "rbtree.h"
+
+/**
+ * @brief Shards rbtrees, a key goes to the shard its hash picks. Each
+ * shard has its own reader-writer lock and sits on cache lines of its
+ * own, so point operations on different shards never contend, not
+ * even on a lock word.
+ *
+ * Ordered walks take every shard's lock shared (always in index order,
+ * writers only ever hold one) and k-way merge the shards, so they see
+ * one consistent state of the whole container.
+ */
+template <typename Tree, typename Key, size_t Shards>
+class sharded_tree {
+  static_assert(Shards > 0 && (Shards & (Shards - 1)) == 0,
+                "the shard count must be a power of two");
+
+ protected:
+  using lock_type = std::shared_timed_mutex;
+  using read_lock = std::shared_lock<lock_type>;
+  using write_lock = std::lock_guard<lock_type>;
+  using value_type = typename Tree::value_type;
+
+  struct alignas(64) shard {
+    mutable lock_type m_lock;
+    Tree m_tree;
+  };
+
+  shard m_shards[Shards];
+
+ public:
+  sharded_tree() = default;
+
+  sharded_tree(const sharded_tree&) = delete;
+
+  sharded_tree& operator=(const sharded_tree&) = delete;
+
+  /**
+   * @brief exact when no writer runs concurrently, otherwise a value
+   * the size had at some point during the call.
+   */
+  size_t size() const {
+    size_t n = 0;
+    for (const shard& s : m_shards) {
+      read_lock locker(s.m_lock);
+      n += s.m_tree.size();
+    }
+    return n;
+  }
+
+  bool empty() const
+  { return size() == 0; }
+
+  void clear() {
+    for (shard& s : m_shards) {
+      Tree old;
+      {
+        write_lock locker(s.m_lock);
+        std::swap(old, s.m_tree);
+      }
+    }
+  }
+
+  /**
+   * @brief call f on every element in ascending order, on one
+   * consistent snapshot; writers wait until f has seen everything.
+   */
+  template <typename F>
+  void for_each(F f) const {
+    using iterator = typename Tree::const_iterator;
+    using range = std::pair<iterator, iterator>;
+    std::vector<read_lock> locks;
+    locks.reserve(Shards);
+    for (const shard& s : m_shards)
+      locks.emplace_back(s.m_lock);
+    std::vector<range> heap;
+    for (const shard& s : m_shards)
+      if (!s.m_tree.empty())
+        heap.emplace_back(s.m_tree.begin(), s.m_tree.end());
+    auto greater = [](const range& x, const range& y)
+    { return __key(*y.first) < __key(*x.first); };
+    std::make_heap(heap.begin(), heap.end(), greater);
+    while (!heap.empty()) {
+      std::pop_heap(heap.begin(), heap.end(), greater);
+      range& r = heap.back();
+      f(*r.first);
+      if (++r.first != r.second)
+        std::push_heap(heap.begin(), heap.end(), greater);
+      else
+        heap.pop_back();
+    }
+  }
+
+  /**
+   * @brief the elements in ascending order, see for_each.
+   */
+  std::vector<value_type> to_vector() const {
+    std::vector<value_type> out;
+    for_each([&out](const value_type& x) { out.push_back(x); });
+    return out;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const sharded_tree& x) {
+    bool first = true;
+    os << '{';
+    x.for_each([&](const value_type& e) {
+      if (!first) os << ", ";
+      os << e;
+      first = false;
+    });
+    return os << '}';
+  }
+
+ protected:
+  static const Key& __key(const Key& x)
+  { return x; }
+
+  template <typename V>
+  static const Key& __key(const std::pair<Key, V>& x)
+  { return x.first; }
+
+  // the top bits of a multiplicative hash, std::hash of an integer
+  // being the integer itself.
+  shard& __shard(const Key& key) {
+    uint64_t h = uint64_t(std::hash<Key>()(key)) * 0x9E3779B97F4A7C15ull;
+    return m_shards[(h >> 32) & (Shards - 1)];
+  }
+
+  const shard& __shard(const Key& key) const
+  { return const_cast<sharded_tree*>(this)->__shard(key); }
+};
+
+/**
+ * @brief set safe to share between threads, see sharded_tree.
+ */
+template <typename T, size_t Shards=64>
+class concurrent_set : public sharded_tree<rbtree<T>, T, Shards> {
+ protected:
+  using base = sharded_tree<rbtree<T>, T, Shards>;
+  using typename base::read_lock;
+  using typename base::write_lock;
+  using typename base::value_type;
+
+ public:
+  concurrent_set() = default;
+
+  concurrent_set(std::initializer_list<T> l) {
+    for (const T& x : l)
+      insert(x);
+  }
+
+  bool insert(const T& x) {
+    auto& s = this->__shard(x);
+    write_lock locker(s.m_lock);
+    return s.m_tree.insert_unique(x);
+  }
+
+  bool insert(T&& x) {
+    auto& s = this->__shard(x);
+    write_lock locker(s.m_lock);
+    return s.m_tree.insert_unique(std::move(x));
+  }
+
+  bool erase(const T& x) {
+    typename rbtree<T>::node_type nh;
+    auto& s = this->__shard(x);
+    {
+      write_lock locker(s.m_lock);
+      nh = s.m_tree.extract(x);
+    }
+    // the node is freed here, outside the lock.
+    return !nh.empty();
+  }
+
+  bool contains(const T& x) const {
+    auto& s = this->__shard(x);
+    read_lock locker(s.m_lock);
+    return s.m_tree.contains(x);
+  }
+
+  size_t count(const T& x) const
+  { return contains(x) ? 1 : 0; }
+};
+
+/**
+ * @brief map safe to share between threads, see sharded_tree. Values
+ * are handed out by copy; update() changes one in place under the
+ * shard's lock.
+ */
+template <typename K, typename V, size_t Shards=64>
+class concurrent_map
+  : public sharded_tree<rbtree<std::pair<K, V>>, K, Shards> {
+ protected:
+  using tree_type = rbtree<std::pair<K, V>>;
+  using base = sharded_tree<tree_type, K, Shards>;
+  using typename base::read_lock;
+  using typename base::write_lock;
+
+ public:
+  concurrent_map() = default;
+
+  concurrent_map(std::initializer_list<std::pair<K, V>> l) {
+    for (const auto& x : l)
+      insert(x);
+  }
+
+  bool insert(const std::pair<K, V>& x) {
+    auto& s = this->__shard(x.first);
+    write_lock locker(s.m_lock);
+    return s.m_tree.insert_unique(x);
+  }
+
+  bool insert(std::pair<K, V>&& x) {
+    auto& s = this->__shard(x.first);
+    write_lock locker(s.m_lock);
+    return s.m_tree.insert_unique(std::move(x));
+  }
+
+  /**
+   * @return true if key was inserted, false if its value was replaced.
+   */
+  bool insert_or_assign(const K& key, const V& value) {
+    auto& s = this->__shard(key);
+    write_lock locker(s.m_lock);
+    auto res = s.m_tree.try_emplace_unique(key, key, value);
+    if (!res.second)
+      res.first->m_data.second = value;
+    return res.second;
+  }
+
+  bool erase(const K& key) {
+    typename tree_type::node_type nh;
+    auto& s = this->__shard(key);
+    {
+      write_lock locker(s.m_lock);
+      nh = s.m_tree.extract(key);
+    }
+    return !nh.empty();
+  }
+
+  /**
+   * @brief copy the value of key into out.
+   * @return false, leaving out alone, when key is absent.
+   */
+  bool find(const K& key, V& out) const {
+    auto& s = this->__shard(key);
+    read_lock locker(s.m_lock);
+    auto x = s.m_tree.find(key);
+    if (x == s.m_tree.end().node())
+      return false;
+    out = x->m_data.second;
+    return true;
+  }
+
+  /**
+   * @brief call f(V&) on the value of key under the shard's write
+   * lock; with a default value inserted first when insert is set.
+   * @return false when key is absent and was not inserted.
+   */
+  template <typename F>
+  bool update(const K& key, F f, bool insert=false) {
+    auto& s = this->__shard(key);
+    write_lock locker(s.m_lock);
+    auto x = s.m_tree.find(key);
+    if (x == s.m_tree.end().node()) {
+      if (!insert)
+        return false;
+      x = s.m_tree.try_emplace_unique(key, key, V()).first;
+    }
+    f(x->m_data.second);
+    return true;
+  }
+
+  bool contains(const K& key) const {
+    auto& s = this->__shard(key);
+    read_lock locker(s.m_lock);
+    return s.m_tree.contains(key);
+  }
+
+  size_t count(const K& key) const
+  { return contains(key) ? 1 : 0; }
+};
@@ -0,0 +1,492 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include "../components/mempool.h"
+#include "rbtree.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief 16 control bytes looked at together: a byte is EMPTY or the
+ * low 7 hash bits of the entry in that slot.
+ */
+struct hashmap_group {
+  static constexpr int WIDTH = 16;
+  static constexpr uint8_t EMPTY = 0x80;
+
+#ifdef __SSE2__
+  explicit hashmap_group(const uint8_t* p)
+    : m_ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) {}
+
+  uint32_t match(uint8_t h2) const {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(m_ctrl, _mm_set1_epi8(h2)));
+  }
+
+  uint32_t match_empty() const
+  { return _mm_movemask_epi8(m_ctrl); }
+
+  __m128i m_ctrl;
+#else
+  explicit hashmap_group(const uint8_t* p)
+  { std::memcpy(m_ctrl, p, WIDTH); }
+
+  uint32_t match(uint8_t h2) const {
+    uint32_t mask = 0;
+    for (int i = 0; i < WIDTH; i++)
+      mask |= uint32_t(m_ctrl[i] == h2) << i;
+    return mask;
+  }
+
+  uint32_t match_empty() const {
+    uint32_t mask = 0;
+    for (int i = 0; i < WIDTH; i++)
+      mask |= uint32_t(m_ctrl[i] >> 7) << i;
+    return mask;
+  }
+
+  uint8_t m_ctrl[WIDTH];
+#endif
+};
+
+/**
+ * @brief flat open-addressing hash map.
+ *
+ * Entries sit in one slot array next to a control byte array; a probe
+ * compares 16 control bytes at once (SSE2 when available) and touches
+ * a slot only when its 7-bit hash tag matches. Probing is linear, so
+ * erase shifts the following entries of the run back instead of
+ * leaving tombstones, and lookups never wade through dead slots.
+ * Storage comes from Alloc. The table doubles at 7/8 load.
+ *
+ * @attention insert may rehash and erase may move other entries:
+ * both invalidate iterators.
+ */
+template <typename K, typename V, typename Hash=std::hash<K>,
+          typename Alloc=tiny_allocator<std::pair<K, V>>>
+class flat_hash_map {
+ protected:
+  template <typename _Tp, typename _Up>
+  struct alloc_rebind {};
+
+  template <template <typename, typename...> class _Template,
+            typename _Up, typename _Tp, typename... _Types>
+  struct alloc_rebind<_Template<_Tp, _Types...>, _Up>
+  { using type = _Template<_Up, _Types...>; };
+
+  using slot_type = std::pair<K, V>;
+  using slot_allocator = typename alloc_rebind<Alloc, slot_type>::type;
+  using ctrl_allocator = typename alloc_rebind<Alloc, uint8_t>::type;
+
+  static constexpr int WIDTH = hashmap_group::WIDTH;
+  static constexpr uint8_t EMPTY = hashmap_group::EMPTY;
+  static constexpr size_t MINCAP = 16;
+
+  // the control array has WIDTH - 1 bytes more than the slots, copies
+  // of the first ones, so a group may start at any slot.
+  struct hashmap_impl : public slot_allocator, public ctrl_allocator, Hash
+  { slot_type* m_slots;
+    uint8_t* m_ctrl;
+    size_t m_mask;
+    size_t m_size;
+  };
+
+  hashmap_impl m_impl;
+
+ public:
+  template <typename P>
+  class basic_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = slot_type;
+    using difference_type = ptrdiff_t;
+    using pointer = P*;
+    using reference = P&;
+
+    basic_iterator() : m_map(nullptr), m_index(0) {}
+
+    basic_iterator(const flat_hash_map* map, size_t index)
+      : m_map(map), m_index(index) {}
+
+    template <typename U, typename = typename std::enable_if<
+      std::is_same<const U, P>::value>::type>
+    basic_iterator(const basic_iterator<U>& it)
+      : m_map(it.m_map), m_index(it.m_index) {}
+
+    reference operator*() const { return m_map->m_impl.m_slots[m_index]; }
+
+    pointer operator->() const { return &m_map->m_impl.m_slots[m_index]; }
+
+    basic_iterator& operator++() {
+      m_index = m_map->__next_full(m_index + 1);
+      return *this;
+    }
+
+    basic_iterator operator++(int) {
+      basic_iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    friend bool operator==(const basic_iterator& x, const basic_iterator& y)
+    { return x.m_index == y.m_index; }
+
+    friend bool operator!=(const basic_iterator& x, const basic_iterator& y)
+    { return !(x == y); }
+
+   private:
+    template <typename> friend class basic_iterator;
+
+    const flat_hash_map* m_map;
+    size_t m_index;
+  };
+
+  using iterator = basic_iterator<slot_type>;
+  using const_iterator = basic_iterator<const slot_type>;
+
+ public:
+  flat_hash_map() : m_impl() { reset(); }
+
+  flat_hash_map(std::initializer_list<slot_type> l) : flat_hash_map() {
+    reserve(l.size());
+    for (const slot_type& x : l)
+      insert(x);
+  }
+
+  template <typename InputIt>
+  flat_hash_map(InputIt first, InputIt last) : flat_hash_map() {
+    for (; first != last; ++first)
+      insert(*first);
+  }
+
+  flat_hash_map(const flat_hash_map& x) : flat_hash_map() {
+    reserve(x.size());
+    for (const slot_type& e : x)
+      __insert_new(e.first, e);
+  }
+
+  flat_hash_map(flat_hash_map&& x) : m_impl() {
+    reset();
+    swap(x);
+  }
+
+  ~flat_hash_map() { __release(); }
+
+  flat_hash_map& operator=(const flat_hash_map& x) {
+    if (this != &x) {
+      flat_hash_map tmp(x);
+      swap(tmp);
+    }
+    return *this;
+  }
+
+  flat_hash_map& operator=(flat_hash_map&& x) {
+    if (this != &x) {
+      clear();
+      swap(x);
+    }
+    return *this;
+  }
+
+  void swap(flat_hash_map& x) {
+    std::swap(m_impl.m_slots, x.m_impl.m_slots);
+    std::swap(m_impl.m_ctrl, x.m_impl.m_ctrl);
+    std::swap(m_impl.m_mask, x.m_impl.m_mask);
+    std::swap(m_impl.m_size, x.m_impl.m_size);
+  }
+
+ public:
+  iterator begin()
+  { return iterator(this, __next_full(0)); }
+
+  iterator end()
+  { return iterator(this, capacity()); }
+
+  const_iterator begin() const
+  { return const_iterator(this, __next_full(0)); }
+
+  const_iterator end() const
+  { return const_iterator(this, capacity()); }
+
+  bool insert(const slot_type& x)
+  { return try_emplace(x.first, x.second).second; }
+
+  bool insert(slot_type&& x)
+  { return try_emplace(std::move(x.first), std::move(x.second)).second; }
+
+  template <typename... Args>
+  bool emplace(Args&&... args) {
+    slot_type tmp(std::forward<Args>(args)...);
+    return insert(std::move(tmp));
+  }
+
+  /**
+   * @brief insert {key, V(args...)} unless key is present, in which
+   * case args are not touched.
+   */
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+    return __try_emplace(key, std::piecewise_construct,
+      std::forward_as_tuple(key),
+      std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+    return __try_emplace(key, std::piecewise_construct,
+      std::forward_as_tuple(std::move(key)),
+      std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  bool erase(const slot_type& x)
+  { return erase(x.first); }
+
+  template <typename U>
+  bool erase(const U& key) {
+    size_t i = __find(key);
+    if (i == capacity())
+      return false;
+    __erase_at(i);
+    return true;
+  }
+
+  template <typename U>
+  iterator find(const U& key)
+  { return iterator(this, __find(key)); }
+
+  template <typename U>
+  const_iterator find(const U& key) const
+  { return const_iterator(this, __find(key)); }
+
+  template <typename U>
+  bool contains(const U& key) const
+  { return __find(key) != capacity(); }
+
+  template <typename U>
+  size_t count(const U& key) const
+  { return contains(key) ? 1 : 0; }
+
+  V& operator[](const K& key)
+  { return try_emplace(key).first->second; }
+
+  V& operator[](K&& key)
+  { return try_emplace(std::move(key)).first->second; }
+
+  const V& operator[](const K& key) const {
+    size_t i = __find(key);
+    if (i == capacity()) {
+      std::ostringstream msg;
+      msg << "KeyError: " << key;
+      throw std::logic_error(msg.str());
+    }
+    else
+      return m_impl.m_slots[i].second;
+  }
+
+  bool empty() const
+  { return size() == 0; }
+
+  size_t size() const
+  { return m_impl.m_size; }
+
+  size_t capacity() const
+  { return m_impl.m_slots == nullptr ? 0 : m_impl.m_mask + 1; }
+
+  void clear() {
+    for (size_t i = 0; i < capacity(); i++) {
+      if (m_impl.m_ctrl[i] != EMPTY) {
+        m_impl.m_slots[i].~slot_type();
+        m_impl.m_ctrl[i] = EMPTY;
+      }
+    }
+    if (capacity() != 0)
+      std::memset(m_impl.m_ctrl + capacity(), EMPTY, WIDTH - 1);
+    m_impl.m_size = 0;
+  }
+
+  /**
+   * @brief make room for n entries without a rehash.
+   */
+  void reserve(size_t n) {
+    size_t cap = MINCAP;
+    while (cap - cap / 8 < n)
+      cap *= 2;
+    if (cap > capacity())
+      __rehash(cap);
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const flat_hash_map& x) {
+    os << '{';
+    auto it = x.begin();
+    if (it != x.end()) {
+      os << *it;
+      for (++it; it != x.end(); ++it)
+        os << ", " << *it;
+    }
+    return os << '}';
+  }
+
+ protected:
+  void reset() {
+    m_impl.m_slots = nullptr;
+    m_impl.m_ctrl = nullptr;
+    m_impl.m_mask = 0;
+    m_impl.m_size = 0;
+  }
+
+  void __release() {
+    if (m_impl.m_slots == nullptr)
+      return;
+    clear();
+    m_impl.slot_allocator::deallocate(m_impl.m_slots, capacity());
+    m_impl.ctrl_allocator::deallocate(m_impl.m_ctrl, capacity() + WIDTH - 1);
+    reset();
+  }
+
+  // std::hash of an integer is the integer itself; spread its bits so
+  // both the home slot and the 7-bit tag see all of them.
+  template <typename U>
+  size_t __hash(const U& key) const {
+    uint64_t h = uint64_t(m_impl.Hash::operator()(key)) *
+                 0x9E3779B97F4A7C15ull;
+    return size_t(h ^ (h >> 32));
+  }
+
+  static uint8_t __h2(size_t h)
+  { return uint8_t(h & 0x7f); }
+
+  size_t __home(size_t h) const
+  { return (h >> 7) & m_impl.m_mask; }
+
+  void __set_ctrl(size_t i, uint8_t c) {
+    m_impl.m_ctrl[i] = c;
+    if (i < size_t(WIDTH - 1))
+      m_impl.m_ctrl[i + capacity()] = c;
+  }
+
+  static int __ctz(uint32_t x)
+  { return __builtin_ctz(x); }
+
+  size_t __next_full(size_t i) const {
+    for (; i < capacity(); i++)
+      if (m_impl.m_ctrl[i] != EMPTY)
+        return i;
+    return capacity();
+  }
+
+  // index of the entry with this key, capacity() when there is none.
+  template <typename U>
+  size_t __find(const U& key) const {
+    if (m_impl.m_size == 0)
+      return capacity();
+    size_t h = __hash(key);
+    uint8_t tag = __h2(h);
+    size_t pos = __home(h);
+    while (true) {
+      hashmap_group g(m_impl.m_ctrl + pos);
+      for (uint32_t m = g.match(tag); m != 0; m &= m - 1) {
+        size_t i = (pos + __ctz(m)) & m_impl.m_mask;
+        if (m_impl.m_slots[i].first == key)
+          return i;
+      }
+      if (g.match_empty() != 0)
+        return capacity();
+      pos = (pos + WIDTH) & m_impl.m_mask;
+    }
+  }
+
+  // first empty slot of the run starting at h's home.
+  size_t __find_empty(size_t h) const {
+    size_t pos = __home(h);
+    while (true) {
+      hashmap_group g(m_impl.m_ctrl + pos);
+      uint32_t m = g.match_empty();
+      if (m != 0)
+        return (pos + __ctz(m)) & m_impl.m_mask;
+      pos = (pos + WIDTH) & m_impl.m_mask;
+    }
+  }
+
+  template <typename U, typename... Args>
+  std::pair<iterator, bool> __try_emplace(const U& key, Args&&... args) {
+    size_t i = __find(key);
+    if (i != capacity())
+      return std::pair<iterator, bool>(iterator(this, i), false);
+    if (m_impl.m_size + 1 > capacity() - capacity() / 8)
+      __rehash(capacity() == 0 ? MINCAP : capacity() * 2);
+    return std::pair<iterator, bool>(
+      iterator(this, __insert_new(key, std::forward<Args>(args)...)), true);
+  }
+
+  // key is known to be absent and there is room.
+  template <typename U, typename... Args>
+  size_t __insert_new(const U& key, Args&&... args) {
+    size_t h = __hash(key);
+    size_t i = __find_empty(h);
+    new (m_impl.m_slots + i) slot_type(std::forward<Args>(args)...);
+    __set_ctrl(i, __h2(h));
+    ++m_impl.m_size;
+    return i;
+  }
+
+  /**
+   * @brief backward-shift deletion: pull each later entry of the run
+   * into the hole when that keeps it between its home and where it
+   * was, so no probe ever has to step over a dead slot.
+   */
+  void __erase_at(size_t i) {
+    size_t mask = m_impl.m_mask;
+    m_impl.m_slots[i].~slot_type();
+    for (size_t j = (i + 1) & mask; m_impl.m_ctrl[j] != EMPTY;
+         j = (j + 1) & mask) {
+      size_t home = __home(__hash(m_impl.m_slots[j].first));
+      if (((j - home) & mask) >= ((j - i) & mask)) {
+        new (m_impl.m_slots + i) slot_type(std::move(m_impl.m_slots[j]));
+        m_impl.m_slots[j].~slot_type();
+        __set_ctrl(i, m_impl.m_ctrl[j]);
+        i = j;
+      }
+    }
+    __set_ctrl(i, EMPTY);
+    --m_impl.m_size;
+  }
+
+  void __rehash(size_t cap) {
+    slot_type* slots = m_impl.slot_allocator::allocate(cap);
+    uint8_t* ctrl;
+    try {
+      ctrl = m_impl.ctrl_allocator::allocate(cap + WIDTH - 1);
+    } catch (...) {
+      m_impl.slot_allocator::deallocate(slots, cap);
+      throw;
+    }
+    std::memset(ctrl, EMPTY, cap + WIDTH - 1);
+    slot_type* old_slots = m_impl.m_slots;
+    uint8_t* old_ctrl = m_impl.m_ctrl;
+    size_t old_cap = capacity();
+    m_impl.m_slots = slots;
+    m_impl.m_ctrl = ctrl;
+    m_impl.m_mask = cap - 1;
+    m_impl.m_size = 0;
+    for (size_t i = 0; i < old_cap; i++) {
+      if (old_ctrl[i] != EMPTY) {
+        __insert_new(old_slots[i].first, std::move(old_slots[i]));
+        old_slots[i].~slot_type();
+      }
+    }
+    if (old_slots != nullptr) {
+      m_impl.slot_allocator::deallocate(old_slots, old_cap);
+      m_impl.ctrl_allocator::deallocate(old_ctrl, old_cap + WIDTH - 1);
+    }
+  }
+};
@@ -0,0 +1,628 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#ifndef __PAIR_OSTREAM__
+#define __PAIR_OSTREAM__
+template <typename _Tp1, typename _Tp2>
+std::ostream& operator<<(std::ostream& os,
+  const std::pair<_Tp1, _Tp2>& pair) {
+  return os << '{' << pair.first << ", " << pair.second << '}';
+}
+#endif
+
+/**
+ * @brief red-black tree whose nodes live in one growable vector and
+ * link to each other by 32-bit index instead of pointer.
+ *
+ * A node is three uint32_t links (the color rides in bit 31 of the
+ * parent index) plus the value: 16 bytes for an int against 40 for
+ * rbnode<int>. Copying the tree copies the vector, a memcpy for
+ * trivially copyable T, and clear() frees everything at once.
+ * Slot 0 is the black nil sentinel, erased slots are kept on a free
+ * list and reused, and holds at most 2^31 - 1 elements. T must be
+ * default constructible (for the sentinel) and assignable (for slot
+ * reuse).
+ */
+template <typename T>
+class idxrbtree {
+ protected:
+  using index = uint32_t;
+
+  static constexpr index nil = 0;
+  static constexpr index RED = 0x80000000u;
+  static constexpr index MAXNODES = RED - 1;
+
+  struct node {
+    index m_parent;
+    index m_lchild;
+    index m_rchild;
+    T m_data;
+  };
+
+  std::vector<node> m_nodes;
+  index m_root;
+  index m_free;
+  size_t m_node_count;
+
+ public:
+  template <typename V>
+  class basic_iterator {
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = typename std::remove_const<V>::type;
+    using difference_type = ptrdiff_t;
+    using pointer = V*;
+    using reference = V&;
+
+    basic_iterator() : m_tree(nullptr), m_index(nil) {}
+
+    basic_iterator(const idxrbtree* tree, index i)
+      : m_tree(tree), m_index(i) {}
+
+    basic_iterator(const basic_iterator<value_type>& it)
+      : m_tree(it.m_tree), m_index(it.m_index) {}
+
+    reference operator*() const
+    { return (reference)m_tree->m_nodes[m_index].m_data; }
+
+    pointer operator->() const { return &**this; }
+
+    basic_iterator& operator++() {
+      m_index = m_tree->next(m_index);
+      return *this;
+    }
+
+    basic_iterator operator++(int) {
+      basic_iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    basic_iterator& operator--() {
+      m_index = m_tree->prev(m_index);
+      return *this;
+    }
+
+    basic_iterator operator--(int) {
+      basic_iterator tmp = *this;
+      --*this;
+      return tmp;
+    }
+
+    friend bool operator==(const basic_iterator& x, const basic_iterator& y)
+    { return x.m_index == y.m_index; }
+
+    friend bool operator!=(const basic_iterator& x, const basic_iterator& y)
+    { return x.m_index != y.m_index; }
+
+   private:
+    friend class idxrbtree;
+
+    const idxrbtree* m_tree;
+    index m_index;
+  };
+
+  using value_type = T;
+  using iterator = basic_iterator<T>;
+  using const_iterator = basic_iterator<const T>;
+
+ public:
+  idxrbtree() : m_nodes(1), m_root(nil), m_free(nil), m_node_count(0)
+  { m_nodes[nil].m_parent = nil; }
+
+  idxrbtree(const idxrbtree&) = default;
+
+  idxrbtree(idxrbtree&& tree)
+    : m_nodes(std::move(tree.m_nodes)), m_root(tree.m_root),
+      m_free(tree.m_free), m_node_count(tree.m_node_count)
+  { tree.clear(); }
+
+  idxrbtree& operator=(const idxrbtree&) = default;
+
+  idxrbtree& operator=(idxrbtree&& tree) {
+    if (this == &tree) return *this;
+    m_nodes = std::move(tree.m_nodes);
+    m_root = tree.m_root;
+    m_free = tree.m_free;
+    m_node_count = tree.m_node_count;
+    tree.clear();
+    return *this;
+  }
+
+ public:
+  bool insert(const T& value)
+  { return insert_unique(value); }
+
+  bool insert_unique(const T& value)
+  { return __insert_unique(value).second; }
+
+  bool insert_unique(T&& value)
+  { return __insert_unique(std::move(value)).second; }
+
+  void insert_equal(const T& value)
+  { __insert_equal(value); }
+
+  void insert_equal(T&& value)
+  { __insert_equal(std::move(value)); }
+
+  size_t erase(const T& value) {
+    size_t n = 0;
+    for (index x = __lower_bound(value); x != nil && !less(value, key(x)); ) {
+      index y = next(x);
+      __erase(x);
+      x = y;
+      ++n;
+    }
+    return n;
+  }
+
+  void clear() {
+    m_nodes.resize(1);
+    reset();
+  }
+
+  /**
+   * @brief make room for n elements up front, so that inserting them
+   * never reallocates the node vector.
+   */
+  void reserve(size_t n)
+  { m_nodes.reserve(n + 1); }
+
+  size_t size() const
+  { return m_node_count; }
+
+  bool empty() const
+  { return size() == 0; }
+
+  iterator begin()
+  { return iterator(this, __minimum(m_root)); }
+
+  iterator end()
+  { return iterator(this, nil); }
+
+  const_iterator begin() const
+  { return const_iterator(this, __minimum(m_root)); }
+
+  const_iterator end() const
+  { return const_iterator(this, nil); }
+
+  template <typename K>
+  iterator find(const K& k) {
+    index y = __lower_bound(k);
+    return iterator(this, y == nil || less(k, key(y)) ? nil : y);
+  }
+
+  template <typename K>
+  const_iterator find(const K& k) const
+  { return const_cast<idxrbtree*>(this)->find(k); }
+
+  template <typename K>
+  bool contains(const K& k) const
+  { return find(k) != end(); }
+
+  template <typename K>
+  iterator lower_bound(const K& k)
+  { return iterator(this, __lower_bound(k)); }
+
+  template <typename K>
+  const_iterator lower_bound(const K& k) const
+  { return const_iterator(this, __lower_bound(k)); }
+
+  template <typename K>
+  iterator upper_bound(const K& k)
+  { return iterator(this, __upper_bound(k)); }
+
+  template <typename K>
+  const_iterator upper_bound(const K& k) const
+  { return const_iterator(this, __upper_bound(k)); }
+
+  friend std::ostream& operator<<(std::ostream& os, const idxrbtree& tree) {
+    os << '{';
+    auto it = tree.begin();
+    if (it != tree.end()) {
+      os << *it;
+      for (++it; it != tree.end(); ++it)
+        os << ", " << *it;
+    }
+    return os << '}';
+  }
+
+ protected:
+  index& lchild(index x) { return m_nodes[x].m_lchild; }
+
+  index& rchild(index x) { return m_nodes[x].m_rchild; }
+
+  index lchild(index x) const { return m_nodes[x].m_lchild; }
+
+  index rchild(index x) const { return m_nodes[x].m_rchild; }
+
+  index parent(index x) const { return m_nodes[x].m_parent & ~RED; }
+
+  void setParent(index x, index p) {
+    index& bits = m_nodes[x].m_parent;
+    bits = (bits & RED) | p;
+  }
+
+  bool isRed(index x) const { return (m_nodes[x].m_parent & RED) != 0; }
+
+  void setRed(index x) { m_nodes[x].m_parent |= RED; }
+
+  void setBlk(index x) { m_nodes[x].m_parent &= ~RED; }
+
+  const T& key(index x) const { return m_nodes[x].m_data; }
+
+  index __minimum(index x) const {
+    if (x == nil) return nil;
+    while (lchild(x) != nil)
+      x = lchild(x);
+    return x;
+  }
+
+  index __maximum(index x) const {
+    if (x == nil) return nil;
+    while (rchild(x) != nil)
+      x = rchild(x);
+    return x;
+  }
+
+  index next(index x) const {
+    if (rchild(x) != nil)
+      return __minimum(rchild(x));
+    index y = parent(x);
+    while (y != nil && x == rchild(y)) {
+      x = y;
+      y = parent(y);
+    }
+    return y;
+  }
+
+  // prev(end()) is the last element.
+  index prev(index x) const {
+    if (x == nil)
+      return __maximum(m_root);
+    if (lchild(x) != nil)
+      return __maximum(lchild(x));
+    index y = parent(x);
+    while (y != nil && x == lchild(y)) {
+      x = y;
+      y = parent(y);
+    }
+    return y;
+  }
+
+  void reset() {
+    m_root = nil;
+    m_free = nil;
+    m_node_count = 0;
+  }
+
+  template <typename K>
+  index __lower_bound(const K& k) const {
+    index y = nil;
+    index x = m_root;
+    while (x != nil) {
+      if (!less(key(x), k)) {
+        y = x;
+        x = lchild(x);
+      } else {
+        x = rchild(x);
+      }
+    }
+    return y;
+  }
+
+  template <typename K>
+  index __upper_bound(const K& k) const {
+    index y = nil;
+    index x = m_root;
+    while (x != nil) {
+      if (less(k, key(x))) {
+        y = x;
+        x = lchild(x);
+      } else {
+        x = rchild(x);
+      }
+    }
+    return y;
+  }
+
+  /**
+   * @brief take a slot off the free list, or append one. Any reference
+   * into m_nodes is invalid afterwards.
+   */
+  template <typename V>
+  index create_node(V&& value) {
+    if (m_free != nil) {
+      index z = m_free;
+      m_free = lchild(z);
+      m_nodes[z].m_data = std::forward<V>(value);
+      return z;
+    }
+    if (m_nodes.size() > MAXNODES)
+      throw std::length_error("idxrbtree: too many nodes");
+    m_nodes.push_back(node{nil, nil, nil, std::forward<V>(value)});
+    return index(m_nodes.size() - 1);
+  }
+
+  // the slot keeps its value until it is reused.
+  void destroy_node(index z) {
+    lchild(z) = m_free;
+    m_free = z;
+  }
+
+  template <typename V>
+  std::pair<index, bool> __insert_unique(V&& value) {
+    index y = nil;
+    index x = m_root;
+    bool left = true;
+    while (x != nil) {
+      y = x;
+      if (less(value, key(x))) {
+        left = true;
+        x = lchild(x);
+      } else if (less(key(x), value)) {
+        left = false;
+        x = rchild(x);
+      } else {
+        return std::pair<index, bool>(x, false);
+      }
+    }
+    index z = create_node(std::forward<V>(value));
+    __link(z, y, left);
+    return std::pair<index, bool>(z, true);
+  }
+
+  template <typename V>
+  index __insert_equal(V&& value) {
+    index y = nil;
+    index x = m_root;
+    bool left = true;
+    while (x != nil) {
+      y = x;
+      left = less(value, key(x));
+      x = left ? lchild(x) : rchild(x);
+    }
+    index z = create_node(std::forward<V>(value));
+    __link(z, y, left);
+    return z;
+  }
+
+  void __link(index z, index y, bool left) {
+    m_nodes[z].m_parent = y | RED;
+    lchild(z) = nil;
+    rchild(z) = nil;
+    if (y == nil)
+      m_root = z;
+    else if (left)
+      lchild(y) = z;
+    else
+      rchild(y) = z;
+    ++m_node_count;
+    __fixInsert(z);
+  }
+
+  void __leftRotate(index x) {
+    index y = rchild(x);
+    rchild(x) = lchild(y);
+    if (lchild(y) != nil)
+      setParent(lchild(y), x);
+    index p = parent(x);
+    setParent(y, p);
+    if (p == nil)
+      m_root = y;
+    else if (x == lchild(p))
+      lchild(p) = y;
+    else
+      rchild(p) = y;
+    lchild(y) = x;
+    setParent(x, y);
+  }
+
+  void __rightRotate(index x) {
+    index y = lchild(x);
+    lchild(x) = rchild(y);
+    if (rchild(y) != nil)
+      setParent(rchild(y), x);
+    index p = parent(x);
+    setParent(y, p);
+    if (p == nil)
+      m_root = y;
+    else if (x == rchild(p))
+      rchild(p) = y;
+    else
+      lchild(p) = y;
+    rchild(y) = x;
+    setParent(x, y);
+  }
+
+  void __fixInsert(index z) {
+    while (isRed(parent(z))) {
+      index p = parent(z);
+      index g = parent(p);
+      if (p == lchild(g)) {
+        index u = rchild(g);
+        if (isRed(u)) {
+          setBlk(p);
+          setBlk(u);
+          setRed(g);
+          z = g;
+        } else {
+          if (z == rchild(p)) {
+            z = p;
+            __leftRotate(z);
+            p = parent(z);
+          }
+          setBlk(p);
+          setRed(g);
+          __rightRotate(g);
+        }
+      } else {
+        index u = lchild(g);
+        if (isRed(u)) {
+          setBlk(p);
+          setBlk(u);
+          setRed(g);
+          z = g;
+        } else {
+          if (z == lchild(p)) {
+            z = p;
+            __rightRotate(z);
+            p = parent(z);
+          }
+          setBlk(p);
+          setRed(g);
+          __leftRotate(g);
+        }
+      }
+    }
+    setBlk(m_root);
+  }
+
+  // put v where u was; v may be nil, whose parent then guides the fixup.
+  void __transplant(index u, index v) {
+    index p = parent(u);
+    if (p == nil)
+      m_root = v;
+    else if (u == lchild(p))
+      lchild(p) = v;
+    else
+      rchild(p) = v;
+    setParent(v, p);
+  }
+
+  void __erase(index z) {
+    index y = z;
+    bool y_red = isRed(y);
+    index x;
+    if (lchild(z) == nil) {
+      x = rchild(z);
+      __transplant(z, x);
+    } else if (rchild(z) == nil) {
+      x = lchild(z);
+      __transplant(z, x);
+    } else {
+      y = __minimum(rchild(z));
+      y_red = isRed(y);
+      x = rchild(y);
+      if (parent(y) == z) {
+        setParent(x, y);
+      } else {
+        __transplant(y, x);
+        rchild(y) = rchild(z);
+        setParent(rchild(y), y);
+      }
+      __transplant(z, y);
+      lchild(y) = lchild(z);
+      setParent(lchild(y), y);
+      if (isRed(z))
+        setRed(y);
+      else
+        setBlk(y);
+    }
+    if (!y_red)
+      __fixErase(x);
+    destroy_node(z);
+    --m_node_count;
+  }
+
+  void __fixErase(index x) {
+    while (x != m_root && !isRed(x)) {
+      index p = parent(x);
+      if (x == lchild(p)) {
+        index w = rchild(p);
+        if (isRed(w)) {
+          setBlk(w);
+          setRed(p);
+          __leftRotate(p);
+          w = rchild(p);
+        }
+        if (!isRed(lchild(w)) && !isRed(rchild(w))) {
+          setRed(w);
+          x = p;
+        } else {
+          if (!isRed(rchild(w))) {
+            setBlk(lchild(w));
+            setRed(w);
+            __rightRotate(w);
+            w = rchild(p);
+          }
+          if (isRed(p))
+            setRed(w);
+          else
+            setBlk(w);
+          setBlk(p);
+          setBlk(rchild(w));
+          __leftRotate(p);
+          x = m_root;
+        }
+      } else {
+        index w = lchild(p);
+        if (isRed(w)) {
+          setBlk(w);
+          setRed(p);
+          __rightRotate(p);
+          w = lchild(p);
+        }
+        if (!isRed(lchild(w)) && !isRed(rchild(w))) {
+          setRed(w);
+          x = p;
+        } else {
+          if (!isRed(lchild(w))) {
+            setBlk(rchild(w));
+            setRed(w);
+            __leftRotate(w);
+            w = lchild(p);
+          }
+          if (isRed(p))
+            setRed(w);
+          else
+            setBlk(w);
+          setBlk(p);
+          setBlk(lchild(w));
+          __rightRotate(p);
+          x = m_root;
+        }
+      }
+    }
+    setBlk(x);
+  }
+
+  template <typename _Tp>
+  static bool less(const _Tp& x, const _Tp& y)
+  { return x < y; }
+
+  template <typename _Tp1, typename _Tp2>
+  static bool less(const std::pair<_Tp1, _Tp2>& x,
+            const std::pair<_Tp1, _Tp2>& y) {
+    return x.first < y.first;
+  }
+
+  template <typename _Tp1, typename _Tp2, typename _Up>
+  static bool less(const std::pair<_Tp1, _Tp2>& x, const _Up& y) {
+    return x.first < y;
+  }
+
+  template <typename _Up, typename _Tp1, typename _Tp2>
+  static bool less(const _Up& x, const std::pair<_Tp1, _Tp2>& y) {
+    return x < y.first;
+  }
+
+  template <typename _Up, typename _Vp>
+  static bool less(const _Up& x, const _Vp& y)
+  { return x < y; }
+};
+
+template <typename T>
+constexpr typename idxrbtree<T>::index idxrbtree<T>::nil;
+
+template <typename T>
+constexpr typename idxrbtree<T>::index idxrbtree<T>::RED;
+
+template <typename T>
+constexpr typename idxrbtree<T>::index idxrbtree<T>::MAXNODES;
@@ -0,0 +1,645 @@
+#pragma once
+
+#include <atomic>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include "../components/mempool.h"
+#include "../components/epoch.h"
+#include "rbtree.h"
+
+/**
+ * @brief node of a persistent rbtree. Nodes are shared between
+ * versions and never change once another version can see them; the
+ * count says how many parents and tree handles point here.
+ */
+template <typename T>
+struct prbnode {
+  std::atomic<size_t> m_refs;
+  rbcolor m_color;
+  prbnode* m_lchild;
+  prbnode* m_rchild;
+  T m_data;
+
+  bool isRed() const { return m_color == rbcolor::red; }
+
+  bool isBlk() const { return m_color == rbcolor::blk; }
+
+  void setRed() { m_color = rbcolor::red; }
+
+  void setBlk() { m_color = rbcolor::blk; }
+};
+
+/**
+ * @brief persistent (path-copying) red-black tree of unique keys.
+ *
+ * Copying a prbtree is O(1): the copy shares every node and is a
+ * snapshot that later updates of either side never disturb. An update
+ * copies only the nodes on its O(log n) path that some other version
+ * still uses, and works in place on nodes this tree owns alone.
+ * insert and erase are split + join, so they need no parent links.
+ * Nodes go back to the pool allocator when the last version using
+ * them is dropped, whichever thread that happens on.
+ *
+ * A single prbtree object is not thread-safe; share versions between
+ * threads by copying, or publish them through versioned<>.
+ */
+template <typename T, typename Alloc=tiny_allocator<T>>
+class prbtree {
+ protected:
+  template <typename _Tp, typename _Up>
+  struct alloc_rebind {};
+
+  template <template <typename, typename...> class _Template,
+            typename _Up, typename _Tp, typename... _Types>
+  struct alloc_rebind<_Template<_Tp, _Types...>, _Up>
+  { using type = _Template<_Up, _Types...>; };
+
+  using node = prbnode<T>;
+  using allocator_type = typename alloc_rebind<Alloc, node>::type;
+
+  static_assert(!is_arena_allocator<allocator_type>::value,
+                "prbtree versions share nodes across trees, "
+                "which an arena_allocator does not allow");
+
+  struct prbtree_impl : public allocator_type
+  { node* m_root;
+    size_t m_node_count;
+  };
+
+  prbtree_impl m_impl;
+
+ public:
+  using value_type = T;
+
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = ptrdiff_t;
+    using pointer = const T*;
+    using reference = const T&;
+
+    const_iterator() : m_depth(0) {}
+
+    explicit const_iterator(node* rt) : m_depth(0) { descend(rt); }
+
+    reference operator*() const { return m_stack[m_depth - 1]->m_data; }
+
+    pointer operator->() const { return &m_stack[m_depth - 1]->m_data; }
+
+    const_iterator& operator++() {
+      node* x = m_stack[--m_depth];
+      descend(x->m_rchild);
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    friend bool operator==(const const_iterator& x, const const_iterator& y) {
+      return x.m_depth == y.m_depth &&
+             (x.m_depth == 0 || x.m_stack[x.m_depth - 1] ==
+                                y.m_stack[y.m_depth - 1]);
+    }
+
+    friend bool operator!=(const const_iterator& x, const const_iterator& y)
+    { return !(x == y); }
+
+   private:
+    void descend(node* x) {
+      for (; x != nullptr; x = x->m_lchild)
+        m_stack[m_depth++] = x;
+    }
+
+    // a red-black tree of n nodes is at most 2 log2(n + 1) deep.
+    node* m_stack[128];
+    int m_depth;
+  };
+
+  using iterator = const_iterator;
+
+ public:
+  prbtree() { m_impl.m_root = nullptr; m_impl.m_node_count = 0; }
+
+  prbtree(std::initializer_list<T> l) : prbtree() {
+    for (const T& x : l)
+      insert(x);
+  }
+
+  prbtree(const prbtree& tree) {
+    m_impl.m_root = retain(tree.m_impl.m_root);
+    m_impl.m_node_count = tree.m_impl.m_node_count;
+  }
+
+  prbtree(prbtree&& tree) {
+    m_impl.m_root = tree.m_impl.m_root;
+    m_impl.m_node_count = tree.m_impl.m_node_count;
+    tree.m_impl.m_root = nullptr;
+    tree.m_impl.m_node_count = 0;
+  }
+
+  ~prbtree() { clear(); }
+
+  prbtree& operator=(const prbtree& tree) {
+    node* rt = retain(tree.m_impl.m_root);
+    clear();
+    m_impl.m_root = rt;
+    m_impl.m_node_count = tree.m_impl.m_node_count;
+    return *this;
+  }
+
+  prbtree& operator=(prbtree&& tree) {
+    if (this == &tree) return *this;
+    clear();
+    std::swap(m_impl.m_root, tree.m_impl.m_root);
+    std::swap(m_impl.m_node_count, tree.m_impl.m_node_count);
+    return *this;
+  }
+
+ public:
+  bool insert(const T& value)
+  { return insert_unique(value); }
+
+  /**
+   * @brief O(log n); copies the nodes on the path that other versions
+   * still share.
+   */
+  bool insert_unique(const T& value) {
+    if (contains(value))
+      return false;
+    __replace(value, create_node(value));
+    return true;
+  }
+
+  /**
+   * @brief insert value, or replace the element equal to it.
+   */
+  void insert_or_assign(const T& value)
+  { __replace(value, create_node(value)); }
+
+  template <typename K>
+  size_t erase(const K& k) {
+    if (!contains(k))
+      return 0;
+    node *l, *found, *r;
+    int bhl, bhr, bh;
+    __split(take_root(), __black_height(m_impl.m_root), k, l, bhl,
+            found, r, bhr);
+    release(found);
+    set_root(__join2(l, bhl, r, bhr, bh));
+    --m_impl.m_node_count;
+    return 1;
+  }
+
+  template <typename K>
+  const T* find(const K& k) const {
+    node* x = m_impl.m_root;
+    while (x != nullptr) {
+      if (less(k, x->m_data))
+        x = x->m_lchild;
+      else if (less(x->m_data, k))
+        x = x->m_rchild;
+      else
+        return &x->m_data;
+    }
+    return nullptr;
+  }
+
+  template <typename K>
+  bool contains(const K& k) const
+  { return find(k) != nullptr; }
+
+  void clear() {
+    release(m_impl.m_root);
+    m_impl.m_root = nullptr;
+    m_impl.m_node_count = 0;
+  }
+
+  size_t size() const
+  { return m_impl.m_node_count; }
+
+  bool empty() const
+  { return size() == 0; }
+
+  const_iterator begin() const
+  { return const_iterator(m_impl.m_root); }
+
+  const_iterator end() const
+  { return const_iterator(); }
+
+  friend std::ostream& operator<<(std::ostream& os, const prbtree& tree) {
+    os << '{';
+    auto it = tree.begin();
+    if (it != tree.end()) {
+      os << *it;
+      for (++it; it != tree.end(); ++it)
+        os << ", " << *it;
+    }
+    return os << '}';
+  }
+
+ protected:
+  template <typename _Tp>
+  static bool less(const _Tp& x, const _Tp& y)
+  { return x < y; }
+
+  template <typename _Tp1, typename _Tp2>
+  static bool less(const std::pair<_Tp1, _Tp2>& x,
+                   const std::pair<_Tp1, _Tp2>& y) {
+    return x.first < y.first;
+  }
+
+  template <typename _Tp1, typename _Tp2, typename _Up>
+  static bool less(const std::pair<_Tp1, _Tp2>& x, const _Up& y) {
+    return x.first < y;
+  }
+
+  template <typename _Up, typename _Tp1, typename _Tp2>
+  static bool less(const _Up& x, const std::pair<_Tp1, _Tp2>& y) {
+    return x < y.first;
+  }
+
+  template <typename _Up, typename _Vp>
+  static bool less(const _Up& x, const _Vp& y)
+  { return x < y; }
+
+  node* create_node(const T& x) {
+    node* tmp = m_impl.allocate(1);
+    try {
+      new (&tmp->m_data) T(x);
+    } catch (...) {
+      m_impl.deallocate(tmp, 1);
+      throw;
+    }
+    new (&tmp->m_refs) std::atomic<size_t>(1);
+    tmp->m_color = rbcolor::red;
+    tmp->m_lchild = nullptr;
+    tmp->m_rchild = nullptr;
+    return tmp;
+  }
+
+  void destroy_node(node* p) {
+    (&p->m_data)->~T();
+    m_impl.deallocate(p, 1);
+  }
+
+  static node* retain(node* x) {
+    if (x != nullptr)
+      x->m_refs.fetch_add(1, std::memory_order_relaxed);
+    return x;
+  }
+
+  // drop one reference; whoever drops the last frees the node and
+  // lets go of its children.
+  void release(node* x) {
+    while (x != nullptr &&
+           x->m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      release(x->m_lchild);
+      node* next = x->m_rchild;
+      destroy_node(x);
+      x = next;
+    }
+  }
+
+  /**
+   * @brief turn an owned reference into a node this version may
+   * change: the node itself when no one else uses it, otherwise a
+   * private copy sharing its children.
+   */
+  node* own(node* x) {
+    if (x->m_refs.load(std::memory_order_acquire) == 1)
+      return x;
+    node* c = create_node(x->m_data);
+    c->m_color = x->m_color;
+    c->m_lchild = retain(x->m_lchild);
+    c->m_rchild = retain(x->m_rchild);
+    release(x);
+    return c;
+  }
+
+  node* take_root() {
+    node* rt = m_impl.m_root;
+    m_impl.m_root = nullptr;
+    return rt;
+  }
+
+  void set_root(node* rt) {
+    if (rt != nullptr && rt->isRed()) {
+      rt = own(rt);
+      rt->setBlk();
+    }
+    m_impl.m_root = rt;
+  }
+
+  template <typename K>
+  void __replace(const K& k, node* z) {
+    node *l, *found, *r;
+    int bhl, bhr, bh;
+    int bht = __black_height(m_impl.m_root);
+    __split(take_root(), bht, k, l, bhl, found, r, bhr);
+    if (found != nullptr)
+      release(found);
+    else
+      ++m_impl.m_node_count;
+    set_root(__join(l, bhl, z, r, bhr, bh));
+  }
+
+  // Split and join as in rbtree, on owned references: every node that
+  // changes goes through own() first. bh counts the black nodes on a
+  // path down from a subtree root, the root included.
+
+  static bool __is_red(node* x)
+  { return x != nullptr && x->isRed(); }
+
+  static int __black_height(node* x) {
+    int bh = 0;
+    for (; x != nullptr; x = x->m_lchild)
+      bh += x->isBlk() ? 1 : 0;
+    return bh;
+  }
+
+  static node* __make(node* l, node* k, node* r, rbcolor color) {
+    k->m_lchild = l;
+    k->m_rchild = r;
+    k->m_color = color;
+    return k;
+  }
+
+  node* __rotate_left(node* x) {
+    node* y = own(x->m_rchild);
+    x->m_rchild = y->m_lchild;
+    y->m_lchild = x;
+    return y;
+  }
+
+  node* __rotate_right(node* x) {
+    node* y = own(x->m_lchild);
+    x->m_lchild = y->m_rchild;
+    y->m_rchild = x;
+    return y;
+  }
+
+  node* __join_right(node* tl, int bhl, node* k, node* tr, int bhr) {
+    if (!__is_red(tl) && bhl == bhr)
+      return __make(tl, k, tr, rbcolor::red);
+    node* c = own(tl);
+    int bhc = bhl - (c->isBlk() ? 1 : 0);
+    node* r = __join_right(c->m_rchild, bhc, k, tr, bhr);
+    c->m_rchild = r;
+    if (c->isBlk() && r->isRed() && __is_red(r->m_rchild)) {
+      r->m_rchild = own(r->m_rchild);
+      r->m_rchild->setBlk();
+      return __rotate_left(c);
+    }
+    return c;
+  }
+
+  node* __join_left(node* tl, int bhl, node* k, node* tr, int bhr) {
+    if (!__is_red(tr) && bhl == bhr)
+      return __make(tl, k, tr, rbcolor::red);
+    node* c = own(tr);
+    int bhc = bhr - (c->isBlk() ? 1 : 0);
+    node* l = __join_left(tl, bhl, k, c->m_lchild, bhc);
+    c->m_lchild = l;
+    if (c->isBlk() && l->isRed() && __is_red(l->m_lchild)) {
+      l->m_lchild = own(l->m_lchild);
+      l->m_lchild->setBlk();
+      return __rotate_right(c);
+    }
+    return c;
+  }
+
+  node* __join(node* tl, int bhl, node* k, node* tr, int bhr, int& bh) {
+    if (__is_red(tl)) {
+      tl = own(tl);
+      tl->setBlk();
+      ++bhl;
+    }
+    if (__is_red(tr)) {
+      tr = own(tr);
+      tr->setBlk();
+      ++bhr;
+    }
+    if (bhl > bhr) {
+      node* t = __join_right(tl, bhl, k, tr, bhr);
+      bh = bhl;
+      if (t->isRed() && __is_red(t->m_rchild)) {
+        t->setBlk();
+        ++bh;
+      }
+      return t;
+    }
+    if (bhr > bhl) {
+      node* t = __join_left(tl, bhl, k, tr, bhr);
+      bh = bhr;
+      if (t->isRed() && __is_red(t->m_lchild)) {
+        t->setBlk();
+        ++bh;
+      }
+      return t;
+    }
+    bh = bhl;
+    return __make(tl, k, tr, rbcolor::red);
+  }
+
+  node* __join2(node* tl, int bhl, node* tr, int bhr, int& bh) {
+    if (tl == nullptr) {
+      bh = bhr;
+      return tr;
+    }
+    if (tr == nullptr) {
+      bh = bhl;
+      return tl;
+    }
+    node* rest;
+    node* last;
+    int bhrest;
+    __split_last(tl, bhl, rest, bhrest, last);
+    return __join(rest, bhrest, last, tr, bhr, bh);
+  }
+
+  void __split_last(node* t, int bh, node*& rest, int& bhrest,
+                    node*& last) {
+    node* c = own(t);
+    int bhc = bh - (c->isBlk() ? 1 : 0);
+    node* a = c->m_lchild;
+    node* b = c->m_rchild;
+    if (b == nullptr) {
+      c->m_lchild = nullptr;
+      last = c;
+      rest = a;
+      bhrest = bhc;
+      return;
+    }
+    node* r;
+    int bhr;
+    __split_last(b, bhc, r, bhr, last);
+    rest = __join(a, bhc, c, r, bhr, bhrest);
+  }
+
+  template <typename K>
+  void __split(node* t, int bh, const K& k, node*& l, int& bhl,
+               node*& found, node*& r, int& bhr) {
+    if (t == nullptr) {
+      l = r = found = nullptr;
+      bhl = bhr = 0;
+      return;
+    }
+    node* c = own(t);
+    node* a = c->m_lchild;
+    node* b = c->m_rchild;
+    int bhc = bh - (c->isBlk() ? 1 : 0);
+    if (less(k, c->m_data)) {
+      node* rr;
+      int bhrr;
+      __split(a, bhc, k, l, bhl, found, rr, bhrr);
+      r = __join(rr, bhrr, c, b, bhc, bhr);
+    } else if (less(c->m_data, k)) {
+      node* ll;
+      int bhll;
+      __split(b, bhc, k, ll, bhll, found, r, bhr);
+      l = __join(a, bhc, c, ll, bhll, bhl);
+    } else {
+      c->m_lchild = nullptr;
+      c->m_rchild = nullptr;
+      l = a;
+      bhl = bhc;
+      r = b;
+      bhr = bhc;
+      found = c;
+    }
+  }
+};
+
+/**
+ * @brief persistent map: every copy is an O(1) snapshot.
+ */
+template <typename K, typename V>
+class pmap {
+ protected:
+  prbtree<std::pair<K, V>> m_tree;
+
+ public:
+  using const_iterator = typename prbtree<std::pair<K, V>>::const_iterator;
+  using iterator = const_iterator;
+
+  pmap() = default;
+
+  pmap(std::initializer_list<std::pair<K, V>> l) : m_tree(l) {}
+
+  bool insert(const std::pair<K, V>& x)
+  { return m_tree.insert_unique(x); }
+
+  void insert_or_assign(const K& key, const V& value)
+  { m_tree.insert_or_assign(std::pair<K, V>(key, value)); }
+
+  template <typename U>
+  bool erase(const U& key)
+  { return m_tree.erase(key) != 0; }
+
+  template <typename U>
+  const V* find(const U& key) const {
+    const std::pair<K, V>* x = m_tree.find(key);
+    return x != nullptr ? &x->second : nullptr;
+  }
+
+  template <typename U>
+  bool contains(const U& key) const
+  { return m_tree.contains(key); }
+
+  const V& at(const K& key) const {
+    const V* x = find(key);
+    if (x == nullptr) {
+      std::ostringstream msg;
+      msg << "KeyError: " << key;
+      throw std::logic_error(msg.str());
+    }
+    return *x;
+  }
+
+  const V& operator[](const K& key) const
+  { return at(key); }
+
+  bool empty() const
+  { return m_tree.empty(); }
+
+  size_t size() const
+  { return m_tree.size(); }
+
+  void clear()
+  { m_tree.clear(); }
+
+  const_iterator begin() const
+  { return m_tree.begin(); }
+
+  const_iterator end() const
+  { return m_tree.end(); }
+
+  friend std::ostream& operator<<(std::ostream& os, const pmap& x)
+  { return os << x.m_tree; }
+};
+
+/**
+ * @brief the current version of a persistent container, shared
+ * between writers and any number of readers.
+ *
+ * The current version lives behind an atomic pointer. load() copies
+ * it inside an epoch_guard, which is one reference increment and
+ * never blocks; the reader then walks its snapshot with no
+ * synchronization at all, however long it keeps it. store() swaps in
+ * a new version and retires the old one to epoch_domain, so it is not
+ * deleted while a load() may still be copying it. Its nodes are freed
+ * once the last snapshot of it is dropped. update() applies a change
+ * to a private version and publishes it.
+ */
+template <typename Tree>
+class versioned {
+ public:
+  versioned() : m_current(new Tree()) {}
+
+  explicit versioned(Tree tree) : m_current(new Tree(std::move(tree))) {}
+
+  versioned(const versioned&) = delete;
+
+  versioned& operator=(const versioned&) = delete;
+
+  ~versioned() { delete m_current.load(std::memory_order_relaxed); }
+
+  Tree load() const {
+    epoch_guard guard;
+    return *m_current.load(std::memory_order_acquire);
+  }
+
+  void store(Tree tree) {
+    Tree* next = new Tree(std::move(tree));
+    epoch_guard guard;
+    Tree* old = m_current.exchange(next, std::memory_order_acq_rel);
+    epoch_domain::instance().retire(old, &versioned::free_version);
+  }
+
+  /**
+   * @brief apply f to a copy of the current version and publish it.
+   * Writers are serialized; readers are never blocked by f.
+   */
+  template <typename F>
+  void update(F&& f) {
+    std::lock_guard<std::mutex> locker(m_write_mtx);
+    Tree next = load();
+    f(next);
+    store(std::move(next));
+  }
+
+ private:
+  static void free_version(void* p)
+  { delete static_cast<Tree*>(p); }
+
+  std::mutex m_write_mtx;
+  std::atomic<Tree*> m_current;
+};
@@ -1,164 +1,213 @@
 #pragma once
 
-#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <future>
+#include <iterator>
 #include <memory>
 #include <sstream>
 #include <iostream>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "../components/mempool.h"
+#include "../components/threadpool.h"
+
+#ifndef __PAIR_OSTREAM__
+#define __PAIR_OSTREAM__
+template <typename _Tp1, typename _Tp2>
+std::ostream& operator<<(std::ostream& os, 
+  const std::pair<_Tp1, _Tp2>& pair) {
+  return os << '{' << pair.first << ", " << pair.second << '}';
+}
+#endif
 
-#define __TINY_MEMPOOL__
+enum class rbcolor { red = false, blk = true };
 
-class tiny_mempool {
- protected:
- struct memNode { memNode *nextnode = nullptr; };
+struct rbnode_base {
+  rbcolor m_color;
+  rbnode_base* m_parent;
+  rbnode_base* m_lchild;
+  rbnode_base* m_rchild;
+};
 
- protected:
-  std::atomic<memNode*> m_free_head[16];
+struct rbnode_compact_base {
+  uintptr_t m_parent_color;
+  rbnode_compact_base* m_lchild;
+  rbnode_compact_base* m_rchild;
+};
 
- private:
-  tiny_mempool() {}
-
-  ~tiny_mempool()
-  { for (int i = 0; i < 16; i++)
-    { if (m_free_head[i] != nullptr)
-      { memNode *ptr = m_free_head[i];
-        while (ptr != nullptr)
-        { auto nptr = ptr->nextnode;
-          free(ptr);
-          ptr = nptr;
-        }
-      }
-      m_free_head[i] = nullptr;
-    }
-  }
+/**
+ * @brief node link layouts. rb_plain_layout gives the color a field of
+ * its own (32 bytes of links). rb_compact_layout keeps it in the low
+ * bit of the parent pointer (24 bytes): nodes are at least 8-byte
+ * aligned, so that bit is always free. parent() and color() then hand
+ * out small proxies instead of references, which the tree code reads
+ * and assigns through the same way.
+ */
+struct rb_plain_layout {
+  using base = rbnode_base;
 
-  int getindex(int size)
-  { static const unsigned int sizetable[16]
-    = { 8, 16, 24, 32, 40, 48, 56, 64, 72, 80, 88, 96, 104, 112, 120, 128 };
-    int __distance = 0;
-    for (; __distance < 16; __distance++)
-      if (sizetable[__distance] >= size)
-        break;
-    return __distance;
-  }
+  template <typename Node>
+  using parent_ref = Node*&;
 
- public:
-  static tiny_mempool &instance()
-  { static tiny_mempool pool;
-    return pool;
-  }
+  using color_ref = rbcolor&;
 
- public:
-  void *alloc(int size)
-  { if (size > 128) return malloc(size);
-    int index = getindex(size);
-    int realsize = (index + 1) << 3;
-    memNode *p = m_free_head[index];
-    if (p == nullptr)
-      return malloc(realsize);
-    else
-    { while (!m_free_head[index].compare_exchange_weak(p, p->nextnode))
-        if (p == nullptr) return malloc(realsize);
-      return p;
+  template <typename Node>
+  static Node*& parent(const base* x) { return (Node*&)x->m_parent; }
+
+  static rbcolor& color(const base* x) { return (rbcolor&)x->m_color; }
+};
+
+struct rb_compact_layout {
+  using base = rbnode_compact_base;
+
+  template <typename Node>
+  class parent_ref {
+   public:
+    explicit parent_ref(uintptr_t& bits) : m_bits(bits) {}
+
+    operator Node*() const { return (Node*)(m_bits & ~uintptr_t(1)); }
+
+    Node* operator->() const { return *this; }
+
+    parent_ref& operator=(Node* p) {
+      m_bits = (uintptr_t)p | (m_bits & 1);
+      return *this;
     }
-    return nullptr;
-  }
 
-  void delloc(void *ptr, int size)
-  { if (ptr == nullptr) return;
-    if (size > 128) return free(ptr);
-    int index = getindex(size);
-    memNode *pNew = (memNode *)ptr;
-    pNew->nextnode = m_free_head[index];
-    while (!(m_free_head[index].compare_exchange_weak(pNew->nextnode, pNew)))
-    ;
-  }
-  
-  /**
-   * @brief report memory distribute in the pool.
-   * @attention May cause undefined result if 
-   * allocate memory use current pool before this
-   * function return.
-   */
-  void report()
-  { printf("\033[32m\033[1mtiny_mempool report\033[0m\n");
-    printf("\033[34mindex\tnode size   node count\033[0m\n");
-    for (int i = 0; i < 16; ++i)
-    { int n = 0;
-      memNode *p = m_free_head[i];
-      while (p)
-      { n++;
-        p = p->nextnode;
-      }
-      printf("\033[31m%5d\t %3d \033[35mbyte\033[31m   %10d"
-             "\033[0m\n", i, (i + 1) << 3, n);
+    parent_ref& operator=(const parent_ref& x)
+    { return *this = (Node*)x; }
+
+   private:
+    uintptr_t& m_bits;
+  };
+
+  class color_ref {
+   public:
+    explicit color_ref(uintptr_t& bits) : m_bits(bits) {}
+
+    operator rbcolor() const { return rbcolor(m_bits & 1); }
+
+    color_ref& operator=(rbcolor c) {
+      m_bits = (m_bits & ~uintptr_t(1)) | uintptr_t(c);
+      return *this;
     }
-  }
 
+    color_ref& operator=(const color_ref& x)
+    { return *this = rbcolor(x); }
+
+   private:
+    uintptr_t& m_bits;
+  };
+
+  template <typename Node>
+  static parent_ref<Node> parent(const base* x)
+  { return parent_ref<Node>((uintptr_t&)x->m_parent_color); }
+
+  static color_ref color(const base* x)
+  { return color_ref((uintptr_t&)x->m_parent_color); }
 };
 
-template<class T>
-class tiny_allocator { 
- public:
-  using value_type = T;
-  using pointer = T*;
-  using const_pointer = const T*;
-  using reference = T&;
-  using const_reference = const T&;
-  using size_type = size_t;
+/**
+ * @brief per-node augmentation hooks. An augment is mixed into every
+ * node and `update(x)` recomputes x's field from its children; the
+ * tree calls it wherever a subtree changes shape. With the default
+ * the hooks compile to nothing and the node keeps its plain layout.
+ */
+struct rb_no_augment {
+  static constexpr bool enabled = false;
+
+  template <typename Node>
+  static void update(Node*) {}
+};
 
-  tiny_allocator() {}
+/**
+ * @brief subtree size, for select / rank in O(log n).
+ */
+struct rb_size_augment {
+  static constexpr bool enabled = true;
 
-  tiny_allocator(tiny_allocator const &) {}
+  size_t m_size;
 
-  tiny_allocator &operator=(tiny_allocator const &)
-  { return *this; }
+  template <typename Node>
+  static size_t size(const Node* x)
+  { return x == nullptr ? 0 : x->m_size; }
 
-  template<class Other>
-  tiny_allocator(tiny_allocator<Other> const &) {}
+  template <typename Node>
+  static void update(Node* x)
+  { x->m_size = 1 + size(x->lchild()) + size(x->rchild()); }
+};
 
-  template<class Other>
-  tiny_allocator &operator=(tiny_allocator<Other> const &)
-  { return *this; }
+/**
+ * @brief half-open interval [lo, hi), ordered by lo then hi.
+ */
+template <typename K>
+struct rb_interval {
+  K lo;
+  K hi;
 
-  pointer allocate(size_type count)
-  { return (pointer)tiny_mempool::instance()
-      .alloc(count * sizeof(value_type));
-  }
+  friend bool operator<(const rb_interval& x, const rb_interval& y)
+  { return x.lo < y.lo || (!(y.lo < x.lo) && x.hi < y.hi); }
 
-  void deallocate(pointer ptr, size_type count)
-  { return tiny_mempool::instance()
-      .delloc(ptr, count * sizeof(value_type));
-  }
+  friend bool operator==(const rb_interval& x, const rb_interval& y)
+  { return !(x < y) && !(y < x); }
+
+  friend std::ostream& operator<<(std::ostream& os, const rb_interval& x)
+  { return os << '[' << x.lo << ", " << x.hi << ')'; }
 };
 
-template <typename _Tp1, typename _Tp2>
-std::ostream& operator<<(std::ostream& os, 
-  const std::pair<_Tp1, _Tp2>& pair) {
-  return os << '{' << pair.first << ", " << pair.second << '}';
-}
+struct rb_interval_augment_base {};
 
-enum class rbcolor { red = false, blk = true };
+/**
+ * @brief largest hi in the subtree, for overlap / stab queries. The
+ * element is an rb_interval<K> or a pair whose first is one.
+ */
+template <typename K>
+struct rb_interval_augment : rb_interval_augment_base {
+  static_assert(std::is_trivially_copyable<K>::value,
+                "augment fields are not constructed, K must be trivial");
 
-struct rbnode_base {
-  rbcolor m_color;
-  rbnode_base* m_parent;
-  rbnode_base* m_lchild;
-  rbnode_base* m_rchild;
+  static constexpr bool enabled = true;
+
+  K m_max;
+
+  static const rb_interval<K>& interval(const rb_interval<K>& x)
+  { return x; }
+
+  template <typename V>
+  static const rb_interval<K>& interval(const std::pair<rb_interval<K>, V>& x)
+  { return x.first; }
+
+  template <typename Node>
+  static void update(Node* x) {
+    x->m_max = interval(x->m_data).hi;
+    if (x->lchild() != nullptr && x->m_max < x->lchild()->m_max)
+      x->m_max = x->lchild()->m_max;
+    if (x->rchild() != nullptr && x->m_max < x->rchild()->m_max)
+      x->m_max = x->rchild()->m_max;
+  }
 };
 
-template <typename T>
-struct rbnode : public rbnode_base {
+template <typename T, typename Augment=rb_no_augment, 
+          typename Layout=rb_plain_layout>
+struct rbnode : public Layout::base, public Augment {
+  using value_type = T;
+
   T m_data;
 
   T& data() const { return (T&)m_data; }
 
-  rbcolor& color() const { return (rbcolor&)m_color; }
+  typename Layout::color_ref color() const
+  { return Layout::color(this); }
 
-  rbnode*& parent() const { return (rbnode*&)m_parent; }
+  typename Layout::template parent_ref<rbnode> parent() const
+  { return Layout::template parent<rbnode>(this); }
 
-  rbnode*& lchild() const { return (rbnode*&)m_lchild; }
+  rbnode*& lchild() const { return (rbnode*&)this->m_lchild; }
 
-  rbnode*& rchild() const { return (rbnode*&)m_rchild; }
+  rbnode*& rchild() const { return (rbnode*&)this->m_rchild; }
 
   rbnode*& brother() const {
     if (this == parent()->lchild())
@@ -167,7 +216,7 @@ struct rbnode : public rbnode_base {
       return parent()->lchild();
   }
 
-  rbnode*& gparent() const { return parent()->parent(); }
+  decltype(auto) gparent() const { return parent()->parent(); }
 
   rbnode*& uncle() const {
     rbnode* father = parent();
@@ -178,13 +227,13 @@ struct rbnode : public rbnode_base {
       return grandfather->lchild();
   }
 
-  bool isRed() const { return m_color == rbcolor::red; }
+  bool isRed() const { return rbcolor(color()) == rbcolor::red; }
 
-  bool isBlk() const { return m_color == rbcolor::blk; }
+  bool isBlk() const { return rbcolor(color()) == rbcolor::blk; }
 
-  void setRed() { m_color = rbcolor::red; }
+  void setRed() { color() = rbcolor::red; }
 
-  void setBlk() { m_color = rbcolor::blk; }
+  void setBlk() { color() = rbcolor::blk; }
 
   static rbnode* prev(rbnode* x) {
     if (x->isRed() && x->gparent() == x) {
@@ -228,7 +277,133 @@ struct rbnode : public rbnode_base {
 
 };
 
-template <typename T, typename Alloc=tiny_allocator<T>>
+/**
+ * @brief bidirectional iterator over the nodes of an rbtree, V is T
+ * or const T. Decrementing end() gives the last element.
+ */
+template <typename Node, typename V>
+struct rbtree_iterator {
+  using iterator_category = std::bidirectional_iterator_tag;
+  using value_type = typename std::remove_const<V>::type;
+  using difference_type = ptrdiff_t;
+  using pointer = V*;
+  using reference = V&;
+
+  Node* m_node;
+
+  rbtree_iterator() : m_node(nullptr) {}
+
+  explicit rbtree_iterator(Node* x) : m_node(x) {}
+
+  rbtree_iterator(const rbtree_iterator<Node, value_type>& it)
+    : m_node(it.m_node) {}
+
+  Node* node() const { return m_node; }
+
+  reference operator*() const { return m_node->data(); }
+
+  pointer operator->() const { return &m_node->data(); }
+
+  rbtree_iterator& operator++() {
+    m_node = Node::next(m_node);
+    return *this;
+  }
+
+  rbtree_iterator operator++(int) {
+    rbtree_iterator tmp = *this;
+    m_node = Node::next(m_node);
+    return tmp;
+  }
+
+  rbtree_iterator& operator--() {
+    m_node = Node::prev(m_node);
+    return *this;
+  }
+
+  rbtree_iterator operator--(int) {
+    rbtree_iterator tmp = *this;
+    m_node = Node::prev(m_node);
+    return tmp;
+  }
+
+  friend bool operator==(const rbtree_iterator& x, const rbtree_iterator& y)
+  { return x.m_node == y.m_node; }
+
+  friend bool operator!=(const rbtree_iterator& x, const rbtree_iterator& y)
+  { return x.m_node != y.m_node; }
+};
+
+template <typename T, typename Alloc, typename Augment, typename Layout>
+class rbtree;
+
+/**
+ * @brief owns a node taken out of an rbtree by extract(), until it is
+ * linked into a tree again with insert() or destroyed with the handle.
+ * Moving a node between trees this way neither allocates nor copies.
+ */
+template <typename Node, typename NodeAlloc>
+class rbtree_node_handle {
+ public:
+  rbtree_node_handle() : m_node(nullptr) {}
+
+  rbtree_node_handle(rbtree_node_handle&& x)
+    : m_node(x.m_node), m_alloc(x.m_alloc) 
+  { x.m_node = nullptr; }
+
+  rbtree_node_handle& operator=(rbtree_node_handle&& x) {
+    if (this != &x) {
+      reset();
+      m_node = x.m_node;
+      m_alloc = x.m_alloc;
+      x.m_node = nullptr;
+    }
+    return *this;
+  }
+
+  rbtree_node_handle(const rbtree_node_handle&) = delete;
+
+  rbtree_node_handle& operator=(const rbtree_node_handle&) = delete;
+
+  ~rbtree_node_handle() { reset(); }
+
+  bool empty() const { return m_node == nullptr; }
+
+  explicit operator bool() const { return m_node != nullptr; }
+
+  auto& value() const { return m_node->data(); }
+
+  // map nodes only; the key may be changed before reinserting.
+  auto& key() const { return m_node->data().first; }
+
+  auto& mapped() const { return m_node->data().second; }
+
+ private:
+  template <typename, typename, typename, typename>
+  friend class rbtree;
+
+  rbtree_node_handle(Node* x, const NodeAlloc& alloc) 
+    : m_node(x), m_alloc(alloc) {}
+
+  Node* release() {
+    Node* x = m_node;
+    m_node = nullptr;
+    return x;
+  }
+
+  void reset() {
+    if (m_node == nullptr) return;
+    using T = typename Node::value_type;
+    (&m_node->m_data)->~T();
+    m_alloc.deallocate(m_node, 1);
+    m_node = nullptr;
+  }
+
+  Node* m_node;
+  NodeAlloc m_alloc;
+};
+
+template <typename T, typename Alloc=tiny_allocator<T>,
+          typename Augment=rb_no_augment, typename Layout=rb_plain_layout>
 class rbtree {
  protected:
   template <typename _Tp, typename _Up>
@@ -239,25 +414,38 @@ class rbtree {
   struct alloc_rebind<_Template<_Tp, _Types...>, _Up>
   { using type = _Template<_Up, _Types...>; };
 
-  using node = rbnode<T>;
+  using node = rbnode<T, Augment, Layout>;
   using allocator_type = typename alloc_rebind<Alloc, node>::type;
 
   struct rbtree_impl : public allocator_type
-  { rbnode_base m_head;
+  { typename Layout::base m_head;
     size_t m_node_count;
   };
 
   rbtree_impl m_impl;
 
+ public:
+  using value_type = T;
+  using iterator = rbtree_iterator<node, T>;
+  using const_iterator = rbtree_iterator<node, const T>;
+  using node_type = rbtree_node_handle<node, allocator_type>;
+
+  struct insert_return_type {
+    iterator position;
+    bool inserted;
+    node_type node;
+  };
+
  public:
   rbtree() { reset(); }
 
-  rbtree(const rbtree& tree) { 
-    if (tree.empty()) {
-      reset();
+  rbtree(const rbtree& tree) {
+    // with rb_compact_layout the color lives in the head's parent word,
+    // which must hold a value before its color bit is overwritten.
+    reset();
+    if (tree.empty())
       return;
-    }
-    m_impl.m_head.m_color = tree.m_impl.m_head.m_color;
+    head()->color() = tree.head()->color();
     m_impl.m_node_count = tree.m_impl.m_node_count;
     root() = copyfrom(tree.root());
     root()->parent() = head();
@@ -284,35 +472,117 @@ class rbtree {
   bool insert(const T& value) 
   { return insert_unique(value); }
 
-  bool insert_unique(const T& value) {
-    node* pos = root();
-    node* pos_parent = head();
-    while (pos != nullptr) {  
-      pos_parent = pos;
-      if (less(value, pos->data()))
-        pos = pos->lchild();
-      else if (less(pos->data(), value))
-        pos = pos->rchild();
-      else
-        return false;
+  bool insert_unique(const T& value)
+  { return __insert_unique(value).second; }
+
+  bool insert_unique(T&& value)
+  { return __insert_unique(std::move(value)).second; }
+
+  void insert_equal(const T& value)
+  { emplace_equal(value); }
+
+  void insert_equal(T&& value)
+  { emplace_equal(std::move(value)); }
+
+  /**
+   * @brief construct the value in its node, then link it unless an
+   * equal value is already there.
+   * @return the node holding the value and whether it was inserted.
+   */
+  template <typename... Args>
+  std::pair<node*, bool> emplace_unique(Args&&... args) {
+    node* z = create_node(std::forward<Args>(args)...);
+    node* parent;
+    bool left;
+    node* pos = __unique_pos(z->m_data, parent, left);
+    if (pos != nullptr) {
+      destroy_node(z);
+      return std::pair<node*, bool>(pos, false);
     }
-    __insert(pos_parent, value);
-    ++m_impl.m_node_count;
-    return true;
+    return std::pair<node*, bool>(__link(z, parent, left), true);
   }
 
-  void insert_equal(const T& value) {
-    node* pos = root();
-    node* pos_parent = head();
-    while (pos != nullptr) {  
-      pos_parent = pos;
-      if (less(value, pos->data()))
-        pos = pos->lchild();
-      else
-        pos = pos->rchild();
+  template <typename... Args>
+  node* emplace_equal(Args&&... args) {
+    node* z = create_node(std::forward<Args>(args)...);
+    node* parent;
+    bool left;
+    __equal_pos(z->m_data, parent, left);
+    return __link(z, parent, left);
+  }
+
+  /**
+   * @brief hinted insertion: O(1) amortized when the value belongs right
+   * before `hint` (or at the end for hint == end), as when appending
+   * ascending keys, O(log n) otherwise.
+   * @return the node holding the value.
+   */
+  node* insert_unique(node* hint, const T& value)
+  { return emplace_hint_unique(hint, value); }
+
+  node* insert_unique(node* hint, T&& value)
+  { return emplace_hint_unique(hint, std::move(value)); }
+
+  node* insert_equal(node* hint, const T& value)
+  { return emplace_hint_equal(hint, value); }
+
+  node* insert_equal(node* hint, T&& value)
+  { return emplace_hint_equal(hint, std::move(value)); }
+
+  template <typename... Args>
+  node* emplace_hint_unique(node* hint, Args&&... args) {
+    node* z = create_node(std::forward<Args>(args)...);
+    node* parent;
+    bool left;
+    node* pos = __hint_unique_pos(hint, z->m_data, parent, left);
+    if (pos != nullptr) {
+      destroy_node(z);
+      return pos;
     }
-    __insert(pos_parent, value);
-    ++m_impl.m_node_count;
+    return __link(z, parent, left);
+  }
+
+  template <typename... Args>
+  node* emplace_hint_equal(node* hint, Args&&... args) {
+    node* z = create_node(std::forward<Args>(args)...);
+    node* parent;
+    bool left;
+    __hint_equal_pos(hint, z->m_data, parent, left);
+    return __link(z, parent, left);
+  }
+
+  /**
+   * @brief replace the content by the unique values of [first, last).
+   * A strictly ascending range is linked into a balanced tree in O(n),
+   * anything else falls back to one insert_unique per value.
+   */
+  template <typename ForwardIt>
+  void assign_unique(ForwardIt first, ForwardIt last) {
+    clear();
+    if (first == last) return;
+    size_t n = 1;
+    for (ForwardIt prev = first, it = std::next(first); it != last; 
+         prev = it++, ++n) {
+      if (!less(*prev, *it)) {
+        for (; first != last; ++first)
+          insert_unique(*first);
+        return;
+      }
+    }
+    int reddepth = 0;
+    while ((size_t(2) << reddepth) <= n)
+      ++reddepth;
+    root() = __build(first, n, 0, reddepth);
+    root()->parent() = head();
+    node* __min = root();
+    node* __max = root();
+    while (__min->lchild() != nullptr)
+      __min = __min->lchild();
+    while (__max->rchild() != nullptr)
+      __max = __max->rchild();
+    leftmost() = __min;
+    rightmost() = __max;
+    m_impl.m_node_count = n;
   }
 
   size_t erase(const T& value) {
@@ -330,15 +600,24 @@ class rbtree {
   }
 
   void clear() {
-    if (!empty()) {
-      __destroy(root());
-      reset();
-    }
+    __clear(is_arena_allocator<allocator_type>());
   }
 
   size_t size() const
   { return m_impl.m_node_count; }
 
+  iterator begin()
+  { return iterator(leftmost()); }
+
+  iterator end()
+  { return iterator(head()); }
+
+  const_iterator begin() const
+  { return const_iterator(leftmost()); }
+
+  const_iterator end() const
+  { return const_iterator(head()); }
+
   bool empty() const
   { return size() == 0; }
 
@@ -348,6 +627,208 @@ class rbtree {
     std::cout << std::endl;
   }
 
+  /**
+   * @brief single descent lookup, one comparison per level.
+   * @return the node equal to k, or end().node() when there is none.
+   */
+  template <typename K>
+  node* find(const K& k) const {
+    node* y = lower_bound(k);
+    if (y == head() || less(k, y->m_data))
+      return head();
+    return y;
+  }
+
+  template <typename K>
+  bool contains(const K& k) const
+  { return find(k) != head(); }
+
+  template <typename K>
+  size_t count(const K& k) const {
+    size_t n = 0;
+    for (node* x = lower_bound(k); x != head() && !less(k, x->m_data);
+         x = node::next(x))
+      ++n;
+    return n;
+  }
+
+  /**
+   * @brief find k, and on a miss construct a value from args in the
+   * empty link the same descent ended on. args are left untouched
+   * when k is already present.
+   */
+  template <typename K, typename... Args>
+  std::pair<node*, bool> try_emplace_unique(const K& k, Args&&... args) {
+    node* parent;
+    bool left;
+    node* y = __lower_pos(k, parent, left);
+    if (y != head() && !less(k, y->m_data))
+      return std::pair<node*, bool>(y, false);
+    node* z = create_node(std::forward<Args>(args)...);
+    return std::pair<node*, bool>(__link(z, parent, left), true);
+  }
+
+  /**
+   * @brief the k-th smallest element (0-based), end().node() when
+   * k >= size(). Needs rb_size_augment.
+   */
+  node* select(size_t k) const {
+    static_assert(std::is_base_of<rb_size_augment, Augment>::value,
+                  "select() needs an rbtree with rb_size_augment");
+    node* x = root();
+    while (x != nullptr) {
+      size_t nleft = Augment::size(x->lchild());
+      if (k < nleft) {
+        x = x->lchild();
+      } else if (k == nleft) {
+        return x;
+      } else {
+        k -= nleft + 1;
+        x = x->rchild();
+      }
+    }
+    return head();
+  }
+
+  /**
+   * @brief number of elements less than v. Needs rb_size_augment.
+   */
+  template <typename U>
+  size_t rank(const U& v) const {
+    static_assert(std::is_base_of<rb_size_augment, Augment>::value,
+                  "rank() needs an rbtree with rb_size_augment");
+    size_t r = 0;
+    node* x = root();
+    while (x != nullptr) {
+      if (less(x->m_data, v)) {
+        r += Augment::size(x->lchild()) + 1;
+        x = x->rchild();
+      } else {
+        x = x->lchild();
+      }
+    }
+    return r;
+  }
+
+  /**
+   * @brief number of elements in [lo, hi). Needs rb_size_augment.
+   */
+  template <typename U>
+  size_t count_range(const U& lo, const U& hi) const {
+    if (!less(lo, hi))
+      return 0;
+    return rank(hi) - rank(lo);
+  }
+
+  /**
+   * @brief call f(value) on every element whose interval overlaps
+   * [lo, hi), in ascending order. Subtrees that end at or before lo,
+   * or start at or after hi, are skipped whole, so only paths leading
+   * to a match are walked. Needs rb_interval_augment.
+   */
+  template <typename K, typename F>
+  void overlap(const K& lo, const K& hi, F f) const {
+    static_assert(std::is_base_of<rb_interval_augment_base, Augment>::value,
+                  "overlap() needs an rbtree with rb_interval_augment");
+    __overlap(root(), lo, hi, f);
+  }
+
+  /**
+   * @brief call f(value) on every element whose interval contains p,
+   * in ascending order. Needs rb_interval_augment.
+   */
+  template <typename K, typename F>
+  void stab(const K& p, F f) const {
+    static_assert(std::is_base_of<rb_interval_augment_base, Augment>::value,
+                  "stab() needs an rbtree with rb_interval_augment");
+    __stab(root(), p, f);
+  }
+
+  /**
+   * @brief unlink pos and hand its node to the caller, O(log n).
+   */
+  node_type extract(const_iterator pos) {
+    static_assert(!is_arena_allocator<allocator_type>::value,
+                  "an arena_allocator node cannot outlive its tree");
+    node* x = pos.node();
+    __unlink(x);
+    --m_impl.m_node_count;
+    return node_type(x, m_impl);
+  }
+
+  node_type extract(iterator pos)
+  { return extract(const_iterator(pos)); }
+
+  node_type extract(node* pos)
+  { return extract(const_iterator(pos)); }
+
+  template <typename K>
+  node_type extract(const K& k) {
+    node* x = find(k);
+    if (x == head())
+      return node_type();
+    return extract(const_iterator(x));
+  }
+
+  /**
+   * @brief link the node of nh unless its key is present, in which
+   * case the node comes back in the result.
+   */
+  insert_return_type insert_unique(node_type&& nh) {
+    if (nh.empty())
+      return insert_return_type{end(), false, node_type()};
+    node* parent;
+    bool left;
+    node* pos = __unique_pos(nh.m_node->m_data, parent, left);
+    if (pos != nullptr)
+      return insert_return_type{iterator(pos), false, std::move(nh)};
+    return insert_return_type{iterator(__link(nh.release(), parent, left)),
+                              true, node_type()};
+  }
+
+  iterator insert_equal(node_type&& nh) {
+    if (nh.empty())
+      return end();
+    node* parent;
+    bool left;
+    __equal_pos(nh.m_node->m_data, parent, left);
+    return iterator(__link(nh.release(), parent, left));
+  }
+
+  /**
+   * @brief bulk set operations for unique-key trees, in
+   * O(m log(n/m + 1)) for sizes m <= n, built on split and join.
+   * The rvalue forms splice the nodes of `other` into this tree and
+   * leave it empty; the const& forms work on a copy of it. With a pool,
+   * the subtrees below the top few splits are handled in parallel; the
+   * calling thread must not be a worker of that pool.
+   */
+  void set_union(rbtree&& other, ThreadPool* pool = nullptr)
+  { __setop(__op_union, other, pool); }
+
+  void set_union(const rbtree& other, ThreadPool* pool = nullptr)
+  { set_union(rbtree(other), pool); }
+
+  void set_intersection(rbtree&& other, ThreadPool* pool = nullptr)
+  { __setop(__op_intersection, other, pool); }
+
+  void set_intersection(const rbtree& other, ThreadPool* pool = nullptr)
+  { set_intersection(rbtree(other), pool); }
+
+  void set_difference(rbtree&& other, ThreadPool* pool = nullptr)
+  { __setop(__op_difference, other, pool); }
+
+  void set_difference(const rbtree& other, ThreadPool* pool = nullptr)
+  { set_difference(rbtree(other), pool); }
+
+  /**
+   * @brief move the nodes of `src` whose keys are not in this tree
+   * over, without allocating or copying. Nodes with keys already
+   * present stay in `src`.
+   */
+  void merge_unique(rbtree& src, ThreadPool* pool = nullptr)
+  { __setop(__op_merge, src, pool); }
+
   template <typename U>
   node* lower_bound(const U& v) const {
     node* y = head();
@@ -375,7 +856,59 @@ class rbtree {
         x = x->rchild();
       }
     }
-    return y;    
+    return y;
+  }
+
+  /**
+   * @brief out[i] = lower_bound(keys[i]) for i in [0, n).
+   *
+   * Up to LOOKUP_BATCH descents are in flight at once and advance one
+   * level per round; every step prefetches the child it moves to, so
+   * the cache misses of different descents overlap instead of each
+   * level waiting on the previous load. A finished descent hands its
+   * lane to the next key right away.
+   */
+  template <typename U>
+  void lower_bound_batch(const U* keys, size_t n, node** out) const {
+    node* x[LOOKUP_BATCH];
+    node* y[LOOKUP_BATCH];
+    size_t idx[LOOKUP_BATCH];
+    size_t next = 0;
+    int live = 0;
+    for (; live < LOOKUP_BATCH && next < n; ++live) {
+      x[live] = root();
+      y[live] = head();
+      idx[live] = next++;
+    }
+    while (live > 0) {
+      for (int i = 0; i < live; ) {
+        node* p = x[i];
+        if (p != nullptr) {
+          if (!less(p->m_data, keys[idx[i]])) {
+            y[i] = p;
+            p = p->lchild();
+          } else {
+            p = p->rchild();
+          }
+          x[i] = p;
+          __builtin_prefetch(p);
+          ++i;
+          continue;
+        }
+        out[idx[i]] = y[i];
+        if (next < n) {
+          x[i] = root();
+          y[i] = head();
+          idx[i] = next++;
+        } else {
+          // keep the live lanes packed at the front.
+          --live;
+          x[i] = x[live];
+          y[i] = y[live];
+          idx[i] = idx[live];
+        }
+      }
+    }
   }
 
   rbtree& operator=(const rbtree& tree) {
@@ -411,8 +944,8 @@ class rbtree {
   node* head() const
   { return (node*)(&m_impl.m_head); }
 
-  node*& root() const
-  { return (node*&)m_impl.m_head.m_parent; }
+  decltype(auto) root() const
+  { return head()->parent(); }
 
   node*& leftmost() const
   { return (node*&)m_impl.m_head.m_lchild; }
@@ -420,37 +953,482 @@ class rbtree {
   node*& rightmost() const
   { return (node*&)m_impl.m_head.m_rchild; }
 
-  node* create_node(const T& x) { 
-    node* tmp = m_impl.allocate(1);
-    try {
-       new (&tmp->m_data) T(x);
-    } catch (...) {
-      m_impl.deallocate(tmp, 1);
+  template <typename... Args>
+  node* create_node(Args&&... args) {
+    node* tmp = m_impl.allocate(1);
+    try {
+       new (&tmp->m_data) T(std::forward<Args>(args)...);
+    } catch (...) {
+      m_impl.deallocate(tmp, 1);
+      throw;
+    }
+    return tmp;
+  }
+
+  void destroy_node(node* p) {
+    (&p->m_data)->~T();
+    m_impl.deallocate(p, 1);
+  }
+
+  /**
+   * @brief link the next `n` values of `it` into a subtree whose sizes
+   * split at the middle, so every leaf lies on the last two levels.
+   * Nodes on the last level (`reddepth`) are red, all the others black:
+   * each root-to-leaf path then crosses `reddepth` black nodes.
+   */
+  template <typename ForwardIt>
+  node* __build(ForwardIt& it, size_t n, int depth, int reddepth) {
+    if (n == 0) return nullptr;
+    size_t nleft = (n - 1) / 2;
+    node* lchild = __build(it, nleft, depth + 1, reddepth);
+    node* p = create_node(*it);
+    ++it;
+    if (depth == reddepth && depth != 0)
+      p->setRed();
+    else
+      p->setBlk();
+    node* rchild = __build(it, n - 1 - nleft, depth + 1, reddepth);
+    p->lchild() = lchild;
+    p->rchild() = rchild;
+    if (lchild != nullptr)
+      lchild->parent() = p;
+    if (rchild != nullptr)
+      rchild->parent() = p;
+    Augment::update(p);
+    return p;
+  }
+
+  node* copyfrom(const node* rt) {
+    if (rt == nullptr) return nullptr;
+    node* p = create_node(rt->m_data);
+    p->color() = rt->color();
+    (Augment&)*p = (const Augment&)*rt;
+    node* lchild = copyfrom(rt->lchild());
+    node* rchild = copyfrom(rt->rchild());
+    p->lchild() = lchild;
+    p->rchild() = rchild;
+    if (lchild != nullptr)
+      lchild->parent() = p;
+    if (rchild != nullptr)
+      rchild->parent() = p;
+    return p;
+  }
+
+  enum __setop_kind {
+    __op_union, __op_merge, __op_intersection, __op_difference
+  };
+
+  // below this many nodes in the smaller tree a set operation is not
+  // worth handing to a thread pool.
+  static constexpr size_t PARALLEL_CUTOFF = 1 << 14;
+
+  // descents lower_bound_batch keeps in flight; about what the core
+  // can have outstanding as cache misses.
+  static constexpr int LOOKUP_BATCH = 16;
+
+  struct __setop_step {
+    node* key;
+    node* dup;
+    int job;
+  };
+
+  struct __setop_job {
+    node* t1;
+    int bh1;
+    node* t2;
+    int bh2;
+    node* t;
+    int bh;
+    std::vector<node*> junk;
+  };
+
+  void __setop(__setop_kind op, rbtree& other, ThreadPool* pool) {
+    static_assert(!is_arena_allocator<allocator_type>::value,
+                  "set operations move nodes between trees, "
+                  "which an arena_allocator does not allow");
+    if (this == &other) {
+      if (op == __op_difference)
+        clear();
+      return;
+    }
+    size_t n1 = size();
+    size_t n2 = other.size();
+    node* t1 = root();
+    node* t2 = other.root();
+    int bh1 = __black_height(t1);
+    int bh2 = __black_height(t2);
+    reset();
+    other.reset();
+
+    std::vector<node*> junk;
+    node* t;
+    int bh;
+    if (pool == nullptr || pool->size() == 0 || 
+        n1 < PARALLEL_CUTOFF || n2 < PARALLEL_CUTOFF)
+      t = __setop_rec(op, t1, bh1, t2, bh2, junk, bh);
+    else
+      t = __setop_par(op, t1, bh1, t2, bh2, junk, bh, *pool);
+
+    size_t dropped = 0;
+    if (op == __op_merge) {
+      // duplicates go back to other, in order so each link is O(1).
+      dropped = junk.size();
+      std::sort(junk.begin(), junk.end(), [](node* x, node* y)
+                { return less(x->m_data, y->m_data); });
+      for (node* x : junk)
+        other.__link(x, other.rightmost(), false);
+    } else {
+      for (node* x : junk)
+        dropped += __destroy(x);
+    }
+    if (t != nullptr) {
+      t->setBlk();
+      t->parent() = head();
+      root() = t;
+      node* __min = t;
+      node* __max = t;
+      while (__min->lchild() != nullptr)
+        __min = __min->lchild();
+      while (__max->rchild() != nullptr)
+        __max = __max->rchild();
+      leftmost() = __min;
+      rightmost() = __max;
+      m_impl.m_node_count = n1 + n2 - dropped;
+    }
+  }
+
+  /**
+   * @brief split the work at the top `depth` levels on this thread, run
+   * the independent pieces on the pool, then join the results back
+   * in the same order.
+   */
+  static node* __setop_par(__setop_kind op, node* t1, int bh1, 
+                           node* t2, int bh2, std::vector<node*>& junk,
+                           int& bh, ThreadPool& pool) {
+    int depth = 1;
+    while ((size_t(1) << depth) < 2 * pool.size() && depth < 8)
+      ++depth;
+    std::vector<__setop_step> steps;
+    std::vector<__setop_job> jobs;
+    __setop_plan(op, t1, bh1, t2, bh2, depth, steps, jobs);
+
+    std::vector<std::future<void>> done;
+    for (size_t i = 1; i < jobs.size(); ++i) {
+      __setop_job* j = &jobs[i];
+      auto task = std::make_shared<std::packaged_task<void()>>([op, j] {
+        j->t = __setop_rec(op, j->t1, j->bh1, j->t2, j->bh2, j->junk, j->bh);
+      });
+      done.push_back(task->get_future());
+      pool.addTask([task] { (*task)(); });
+    }
+    __setop_job& j = jobs[0];
+    j.t = __setop_rec(op, j.t1, j.bh1, j.t2, j.bh2, j.junk, j.bh);
+    for (auto& f : done)
+      f.wait();
+    for (auto& f : done)
+      f.get();
+
+    size_t pos = 0;
+    return __setop_gather(op, steps, pos, jobs, junk, bh);
+  }
+
+  static void __setop_plan(__setop_kind op, node* t1, int bh1, 
+                           node* t2, int bh2, int depth,
+                           std::vector<__setop_step>& steps,
+                           std::vector<__setop_job>& jobs) {
+    if (depth == 0 || t1 == nullptr || t2 == nullptr) {
+      steps.push_back(__setop_step{nullptr, nullptr, int(jobs.size())});
+      jobs.push_back(__setop_job{t1, bh1, t2, bh2, nullptr, 0, {}});
+      return;
+    }
+    node* k = t2;
+    node* l2 = k->lchild();
+    node* r2 = k->rchild();
+    int bhc = bh2 - (k->isBlk() ? 1 : 0);
+    node *l1, *r1, *dup;
+    int bhl1, bhr1;
+    __split(t1, bh1, k->m_data, l1, bhl1, dup, r1, bhr1);
+    steps.push_back(__setop_step{k, dup, -1});
+    __setop_plan(op, l1, bhl1, l2, bhc, depth - 1, steps, jobs);
+    __setop_plan(op, r1, bhr1, r2, bhc, depth - 1, steps, jobs);
+  }
+
+  static node* __setop_gather(__setop_kind op,
+                              const std::vector<__setop_step>& steps,
+                              size_t& pos, std::vector<__setop_job>& jobs,
+                              std::vector<node*>& junk, int& bh) {
+    const __setop_step& s = steps[pos++];
+    if (s.job >= 0) {
+      __setop_job& j = jobs[s.job];
+      junk.insert(junk.end(), j.junk.begin(), j.junk.end());
+      bh = j.bh;
+      return j.t;
+    }
+    int bhl, bhr;
+    node* l = __setop_gather(op, steps, pos, jobs, junk, bhl);
+    node* r = __setop_gather(op, steps, pos, jobs, junk, bhr);
+    return __setop_combine(op, l, bhl, s.key, s.dup, r, bhr, junk, bh);
+  }
+
+  /**
+   * @brief split t1 by the root of t2, recurse on both sides, then join.
+   * Nodes that drop out of the result are collected in `junk` and
+   * dealt with by the caller, so this never touches the allocator.
+   */
+  static node* __setop_rec(__setop_kind op, node* t1, int bh1, 
+                           node* t2, int bh2, std::vector<node*>& junk,
+                           int& bh) {
+    if (t1 == nullptr || t2 == nullptr) {
+      bh = 0;
+      switch (op) {
+       case __op_union:
+       case __op_merge:
+        bh = t1 != nullptr ? bh1 : bh2;
+        return t1 != nullptr ? t1 : t2;
+       case __op_intersection:
+        if (t1 != nullptr || t2 != nullptr)
+          junk.push_back(t1 != nullptr ? t1 : t2);
+        return nullptr;
+       case __op_difference:
+        if (t1 != nullptr) {
+          bh = bh1;
+          return t1;
+        }
+        if (t2 != nullptr)
+          junk.push_back(t2);
+        return nullptr;
+      }
+    }
+    node* k = t2;
+    node* l2 = k->lchild();
+    node* r2 = k->rchild();
+    int bhc = bh2 - (k->isBlk() ? 1 : 0);
+    node *l1, *r1, *dup;
+    int bhl1, bhr1, bhl, bhr;
+    __split(t1, bh1, k->m_data, l1, bhl1, dup, r1, bhr1);
+    node* l = __setop_rec(op, l1, bhl1, l2, bhc, junk, bhl);
+    node* r = __setop_rec(op, r1, bhr1, r2, bhc, junk, bhr);
+    return __setop_combine(op, l, bhl, k, dup, r, bhr, junk, bh);
+  }
+
+  static node* __setop_combine(__setop_kind op, node* l, int bhl, 
+                               node* k, node* dup, node* r, int bhr,
+                               std::vector<node*>& junk, int& bh) {
+    switch (op) {
+     case __op_union:
+     case __op_merge:
+      // keep the node already in this tree
+      if (dup != nullptr) {
+        __unlink_junk(k, junk);
+        k = dup;
+      }
+      return __join(l, bhl, k, r, bhr, bh);
+     case __op_intersection:
+      __unlink_junk(k, junk);
+      if (dup != nullptr)
+        return __join(l, bhl, dup, r, bhr, bh);
+      return __join2(l, bhl, r, bhr, bh);
+     case __op_difference:
+      __unlink_junk(k, junk);
+      if (dup != nullptr)
+        __unlink_junk(dup, junk);
+      return __join2(l, bhl, r, bhr, bh);
+    }
+    return nullptr;
+  }
+
+  static void __unlink_junk(node* x, std::vector<node*>& junk) {
+    x->lchild() = nullptr;
+    x->rchild() = nullptr;
+    junk.push_back(x);
+  }
+
+  // Split and join work on detached subtrees whose root may be red, 
+  // and carry each subtree's black height along (bh: black nodes on
+  // a path down to a leaf, the root included, nullptr counts 0).
+  // The parent pointer of a returned root is left for the caller.
+
+  static bool __is_red(node* x)
+  { return x != nullptr && x->isRed(); }
+
+  static int __black_height(node* x) {
+    int bh = 0;
+    for (; x != nullptr; x = x->lchild())
+      bh += x->isBlk() ? 1 : 0;
+    return bh;
+  }
+
+  static node* __make(node* l, node* k, node* r, rbcolor color) {
+    k->lchild() = l;
+    k->rchild() = r;
+    k->color() = color;
+    if (l != nullptr)
+      l->parent() = k;
+    if (r != nullptr)
+      r->parent() = k;
+    Augment::update(k);
+    return k;
+  }
+
+  static node* __rotate_left(node* x) {
+    node* y = x->rchild();
+    x->rchild() = y->lchild();
+    if (x->rchild() != nullptr)
+      x->rchild()->parent() = x;
+    y->lchild() = x;
+    x->parent() = y;
+    Augment::update(x);
+    Augment::update(y);
+    return y;
+  }
+
+  static node* __rotate_right(node* x) {
+    node* y = x->lchild();
+    x->lchild() = y->rchild();
+    if (x->lchild() != nullptr)
+      x->lchild()->parent() = x;
+    y->rchild() = x;
+    x->parent() = y;
+    Augment::update(x);
+    Augment::update(y);
+    return y;
+  }
+
+  // hang k and tr on the right spine of the taller tl, at the first
+  // black node of tr's black height, then fix red-red on the way up.
+  static node* __join_right(node* tl, int bhl, node* k, node* tr, int bhr) {
+    if (!__is_red(tl) && bhl == bhr)
+      return __make(tl, k, tr, rbcolor::red);
+    int bhc = bhl - (tl->isBlk() ? 1 : 0);
+    node* r = __join_right(tl->rchild(), bhc, k, tr, bhr);
+    tl->rchild() = r;
+    r->parent() = tl;
+    Augment::update(tl);
+    if (tl->isBlk() && r->isRed() && __is_red(r->rchild())) {
+      r->rchild()->setBlk();
+      return __rotate_left(tl);
+    }
+    return tl;
+  }
+
+  static node* __join_left(node* tl, int bhl, node* k, node* tr, int bhr) {
+    if (!__is_red(tr) && bhl == bhr)
+      return __make(tl, k, tr, rbcolor::red);
+    int bhc = bhr - (tr->isBlk() ? 1 : 0);
+    node* l = __join_left(tl, bhl, k, tr->lchild(), bhc);
+    tr->lchild() = l;
+    l->parent() = tr;
+    Augment::update(tr);
+    if (tr->isBlk() && l->isRed() && __is_red(l->lchild())) {
+      l->lchild()->setBlk();
+      return __rotate_right(tr);
+    }
+    return tr;
+  }
+
+  /**
+   * @brief tl < k < tr, O(|bhl - bhr| + 1).
+   */
+  static node* __join(node* tl, int bhl, node* k, node* tr, int bhr, 
+                      int& bh) {
+    if (__is_red(tl)) {
+      tl->setBlk();
+      ++bhl;
+    }
+    if (__is_red(tr)) {
+      tr->setBlk();
+      ++bhr;
+    }
+    if (bhl > bhr) {
+      node* t = __join_right(tl, bhl, k, tr, bhr);
+      bh = bhl;
+      if (t->isRed() && __is_red(t->rchild())) {
+        t->setBlk();
+        ++bh;
+      }
+      return t;
+    }
+    if (bhr > bhl) {
+      node* t = __join_left(tl, bhl, k, tr, bhr);
+      bh = bhr;
+      if (t->isRed() && __is_red(t->lchild())) {
+        t->setBlk();
+        ++bh;
+      }
+      return t;
+    }
+    bh = bhl;
+    return __make(tl, k, tr, rbcolor::red);
+  }
+
+  static node* __join2(node* tl, int bhl, node* tr, int bhr, int& bh) {
+    if (tl == nullptr) {
+      bh = bhr;
+      return tr;
     }
-    return tmp;
+    if (tr == nullptr) {
+      bh = bhl;
+      return tl;
+    }
+    node* rest;
+    node* last;
+    int bhrest;
+    __split_last(tl, bhl, rest, bhrest, last);
+    return __join(rest, bhrest, last, tr, bhr, bh);
   }
 
-  void destroy_node(node* p) {
-    (&p->m_data)->~T();
-    m_impl.deallocate(p, 1);
+  static void __split_last(node* t, int bh, node*& rest, int& bhrest, 
+                           node*& last) {
+    int bhc = bh - (t->isBlk() ? 1 : 0);
+    if (t->rchild() == nullptr) {
+      last = t;
+      rest = t->lchild();
+      bhrest = bhc;
+      return;
+    }
+    node* r;
+    int bhr;
+    __split_last(t->rchild(), bhc, r, bhr, last);
+    rest = __join(t->lchild(), bhc, t, r, bhr, bhrest);
   }
 
-  node* copyfrom(const node* rt) {
-    if (rt == nullptr) return nullptr;
-    node* p = create_node(rt->m_data);
-    p->m_color = rt->m_color;
-    node* lchild = copyfrom((const node*)rt->m_lchild);
-    node* rchild = copyfrom((const node*)rt->m_rchild);
-    p->lchild() = lchild;
-    p->rchild() = rchild;
-    if (lchild != nullptr)
-      lchild->parent() = p;
-    if (rchild != nullptr)
-      rchild->parent() = p;
-    return p;
+  /**
+   * @brief split t into the nodes less than k, the node equal to k
+   * (`found`, nullptr if none, its children cut off by the caller) and
+   * the nodes greater than k.
+   */
+  template <typename K>
+  static void __split(node* t, int bh, const K& k, node*& l, int& bhl, 
+                      node*& found, node*& r, int& bhr) {
+    if (t == nullptr) {
+      l = r = found = nullptr;
+      bhl = bhr = 0;
+      return;
+    }
+    node* a = t->lchild();
+    node* b = t->rchild();
+    int bhc = bh - (t->isBlk() ? 1 : 0);
+    if (less(k, t->m_data)) {
+      node* rr;
+      int bhrr;
+      __split(a, bhc, k, l, bhl, found, rr, bhrr);
+      r = __join(rr, bhrr, t, b, bhc, bhr);
+    } else if (less(t->m_data, k)) {
+      node* ll;
+      int bhll;
+      __split(b, bhc, k, ll, bhll, found, r, bhr);
+      l = __join(a, bhc, t, ll, bhll, bhl);
+    } else {
+      l = a;
+      bhl = bhc;
+      r = b;
+      bhr = bhc;
+      found = t;
+    }
   }
 
   void movefrom(rbtree& x) {
+    (allocator_type&)m_impl = std::move((allocator_type&)x.m_impl);
     head()->color() = x.head()->color();
     root() = x.root();
     leftmost() = x.leftmost();
@@ -461,7 +1439,7 @@ class rbtree {
   }
   
   void reset() {
-    m_impl.m_head.m_color = rbcolor::red;
+    head()->setRed();
     root() = nullptr;
     leftmost() = head();
     rightmost() = head();
@@ -478,16 +1456,22 @@ class rbtree {
     return x.first < y.first;
   }
 
-  template <typename _Tp1, typename _Tp2>
-  static bool less(const std::pair<_Tp1, _Tp2>& x, const _Tp1& y) {
+  // keys of any type comparable with _Tp1 (e.g. const char* against
+  // std::string) are looked up as is, without building a pair.
+  template <typename _Tp1, typename _Tp2, typename _Up>
+  static bool less(const std::pair<_Tp1, _Tp2>& x, const _Up& y) {
     return x.first < y;
   }
 
-  template <typename _Tp1, typename _Tp2>
-  static bool less(const _Tp1& x, const std::pair<_Tp1, _Tp2>& y) {
+  template <typename _Up, typename _Tp1, typename _Tp2>
+  static bool less(const _Up& x, const std::pair<_Tp1, _Tp2>& y) {
     return x < y.first;
   }
 
+  template <typename _Up, typename _Vp>
+  static bool less(const _Up& x, const _Vp& y)
+  { return x < y; }
+
  protected:
   void __leftRotate(node* x) {
     node* rchild = x->rchild();
@@ -503,6 +1487,8 @@ class rbtree {
     rchild->parent() = x->parent();
     rchild->lchild() = x;
     x->parent() = rchild;
+    Augment::update(x);
+    Augment::update(rchild);
   }
 
   void __rightRotate(node* x) {
@@ -519,6 +1505,36 @@ class rbtree {
     lchild->parent() = x->parent();
     lchild->rchild() = x;
     x->parent() = lchild;
+    Augment::update(x);
+    Augment::update(lchild);
+  }
+
+  // recurse to the left, loop to the right: the stack stays at the
+  // tree height.
+  template <typename K, typename F>
+  static void __overlap(node* x, const K& lo, const K& hi, F& f) {
+    while (x != nullptr && lo < x->m_max) {
+      __overlap(x->lchild(), lo, hi, f);
+      const auto& iv = Augment::interval(x->m_data);
+      if (!(iv.lo < hi))
+        return;
+      if (lo < iv.hi)
+        f(x->m_data);
+      x = x->rchild();
+    }
+  }
+
+  template <typename K, typename F>
+  static void __stab(node* x, const K& p, F& f) {
+    while (x != nullptr && p < x->m_max) {
+      __stab(x->lchild(), p, f);
+      const auto& iv = Augment::interval(x->m_data);
+      if (p < iv.lo)
+        return;
+      if (p < iv.hi)
+        f(x->m_data);
+      x = x->rchild();
+    }
   }
 
   void __disp(node* rt) const {
@@ -539,25 +1555,194 @@ class rbtree {
     }
   }
 
-  void __destroy(node* pos) {
+  void __clear(std::false_type) {
+    if (!empty()) {
+      __destroy(root());
+      reset();
+    }
+  }
+
+  // the arena frees every node at once, only non-trivial T need a walk.
+  void __clear(std::true_type) {
+    if (!std::is_trivially_destructible<T>::value && !empty())
+      __destroy(root());
+    m_impl.release();
+    reset();
+  }
+
+  size_t __destroy(node* pos) {
+    size_t n = 0;
     while (pos != nullptr) {
-      __destroy(pos->rchild());
+      n += __destroy(pos->rchild());
       node* tmp = pos->lchild();
       destroy_node(pos);
       pos = tmp;
+      ++n;
+    }
+    return n;
+  }
+
+  template <typename V>
+  std::pair<node*, bool> __insert_unique(V&& value) {
+    node* parent;
+    bool left;
+    node* pos = __unique_pos(value, parent, left);
+    if (pos != nullptr)
+      return std::pair<node*, bool>(pos, false);
+    node* z = create_node(std::forward<V>(value));
+    return std::pair<node*, bool>(__link(z, parent, left), true);
+  }
+
+  /**
+   * @brief find where `k` goes: the node equal to `k` if any, otherwise
+   * nullptr and the parent / side of the empty link to fill.
+   */
+  template <typename K>
+  node* __unique_pos(const K& k, node*& parent, bool& left) const {
+    node* pos = root();
+    parent = head();
+    left = true;
+    while (pos != nullptr) {
+      parent = pos;
+      if (less(k, pos->m_data)) {
+        left = true;
+        pos = pos->lchild();
+      } else if (less(pos->m_data, k)) {
+        left = false;
+        pos = pos->rchild();
+      } else {
+        return pos;
+      }
+    }
+    return nullptr;
+  }
+
+  /**
+   * @brief lower_bound that also records the empty link where k would
+   * hang if it is not in the tree.
+   */
+  template <typename K>
+  node* __lower_pos(const K& k, node*& parent, bool& left) const {
+    node* y = head();
+    node* x = root();
+    parent = head();
+    left = true;
+    while (x != nullptr) {
+      parent = x;
+      left = !less(x->m_data, k);
+      if (left) {
+        y = x;
+        x = x->lchild();
+      } else {
+        x = x->rchild();
+      }
+    }
+    return y;
+  }
+
+  template <typename K>
+  void __equal_pos(const K& k, node*& parent, bool& left) const {
+    node* pos = root();
+    parent = head();
+    left = true;
+    while (pos != nullptr) {
+      parent = pos;
+      left = less(k, pos->m_data);
+      pos = left ? pos->lchild() : pos->rchild();
+    }
+  }
+
+  template <typename K>
+  node* __hint_unique_pos(node* hint, const K& k, 
+                          node*& parent, bool& left) const {
+    if (hint == head()) {
+      if (!empty() && less(rightmost()->m_data, k)) {
+        parent = rightmost();
+        left = false;
+        return nullptr;
+      }
+      return __unique_pos(k, parent, left);
+    }
+    if (less(k, hint->m_data)) {
+      if (hint == leftmost()) {
+        parent = hint;
+        left = true;
+        return nullptr;
+      }
+      node* before = node::prev(hint);
+      if (!less(before->m_data, k))
+        return __unique_pos(k, parent, left);
+      // one of before->right and hint->left is always empty.
+      left = before->rchild() != nullptr;
+      parent = left ? hint : before;
+      return nullptr;
+    }
+    if (less(hint->m_data, k)) {
+      if (hint == rightmost()) {
+        parent = hint;
+        left = false;
+        return nullptr;
+      }
+      node* after = node::next(hint);
+      if (!less(k, after->m_data))
+        return __unique_pos(k, parent, left);
+      left = hint->rchild() != nullptr;
+      parent = left ? after : hint;
+      return nullptr;
     }
+    return hint;
   }
 
-  void __insert(node* pos_parent, const T& value) {
-    node* new_node = create_node(value);
+  template <typename K>
+  void __hint_equal_pos(node* hint, const K& k, 
+                        node*& parent, bool& left) const {
+    if (hint == head()) {
+      if (!empty() && !less(k, rightmost()->m_data)) {
+        parent = rightmost();
+        left = false;
+        return;
+      }
+      return __equal_pos(k, parent, left);
+    }
+    if (!less(hint->m_data, k)) {
+      if (hint == leftmost()) {
+        parent = hint;
+        left = true;
+        return;
+      }
+      node* before = node::prev(hint);
+      if (less(k, before->m_data))
+        return __equal_pos(k, parent, left);
+      left = before->rchild() != nullptr;
+      parent = left ? hint : before;
+      return;
+    }
+    if (hint == rightmost()) {
+      parent = hint;
+      left = false;
+      return;
+    }
+    node* after = node::next(hint);
+    if (less(after->m_data, k))
+      return __equal_pos(k, parent, left);
+    left = hint->rchild() != nullptr;
+    parent = left ? after : hint;
+  }
+
+  /**
+   * @brief hang `new_node` under `pos_parent` and rebalance.
+   */
+  node* __link(node* new_node, node* pos_parent, bool left) {
+    new_node->parent() = pos_parent;
+    new_node->lchild() = nullptr;
+    new_node->rchild() = nullptr;
+    ++m_impl.m_node_count;
     if (pos_parent == head()) {
       leftmost() = rightmost() = root() = new_node;
       new_node->setBlk();
-      new_node->parent() = pos_parent;
-      new_node->lchild() = nullptr;
-      new_node->rchild() = nullptr;
-      return;
-    } else if (value < pos_parent->data()) {
+      Augment::update(new_node);
+      return new_node;
+    } else if (left) {
       pos_parent->lchild() = new_node;
       if (pos_parent == leftmost())
         leftmost() = new_node;
@@ -566,13 +1751,31 @@ class rbtree {
       if (pos_parent == rightmost())
         rightmost() = new_node;
     }
-    new_node->parent() = pos_parent;
-    new_node->lchild() = nullptr;
-    new_node->rchild() = nullptr;
+    __propagate(new_node);
     __preFixInsert(new_node);
+    return new_node;
+  }
+
+  /**
+   * @brief refresh the augment on the path from x up to the root.
+   */
+  void __propagate(node* x) {
+    if (!Augment::enabled)
+      return;
+    for (; x != head(); x = x->parent())
+      Augment::update(x);
   }
 
   void __erase(node* pos) {
+    __unlink(pos);
+    destroy_node(pos);
+  }
+
+  /**
+   * @brief take pos out of the tree and rebalance, leaving the node
+   * itself alone. The node count is up to the caller.
+   */
+  void __unlink(node* pos) {
     node* y = pos;
     node* x = nullptr;
     node* x_parent = nullptr;
@@ -645,13 +1848,12 @@ class rbtree {
       }
     }
 
+    __propagate(x_parent);
     if (x == root()) {
       if (x != nullptr)
         x->setBlk();
     } else if (y->isBlk())
       __preFixErase(x, x_parent);
-    
-    destroy_node(y);
   }
 
   void __preFixInsert(node* new_node) {
@@ -808,25 +2010,132 @@ class rbtree {
   
 };
 
-template <typename T>
+/**
+ * @brief rbtree with subtree sizes: select / rank / count_range in
+ * O(log n) on top of the usual operations.
+ */
+template <typename T, typename Alloc=tiny_allocator<T>>
+using ostree = rbtree<T, Alloc, rb_size_augment>;
+
+/**
+ * @brief rbtree with the color bit packed into the parent pointer:
+ * rbnode<int> takes 32 bytes instead of 40.
+ */
+template <typename T, typename Alloc=tiny_allocator<T>>
+using compact_rbtree = rbtree<T, Alloc, rb_no_augment, rb_compact_layout>;
+
+template <typename T, typename Layout=rb_plain_layout>
 class set {
  protected:
-  rbtree<T> m_tree;
+  using tree_type = rbtree<T, tiny_allocator<T>, rb_no_augment, Layout>;
+
+  tree_type m_tree;
 
  public:
   set() = default;
 
-  set(std::initializer_list<T> l) : m_tree() {
-    for (auto&& x : l)
-      m_tree.insert(x);
-  }
+  set(std::initializer_list<T> l) : set(l.begin(), l.end()) {}
+
+  /**
+   * @brief O(n) when [first, last) is strictly ascending,
+   * O(n log n) otherwise.
+   */
+  template <typename ForwardIt>
+  set(ForwardIt first, ForwardIt last) : m_tree()
+  { m_tree.assign_unique(first, last); }
+
+  using iterator = typename tree_type::const_iterator;
+  using const_iterator = iterator;
+
+  iterator begin() const
+  { return m_tree.begin(); }
+
+  iterator end() const
+  { return m_tree.end(); }
 
   bool insert(const T& x)
   { return m_tree.insert_unique(x); }
 
+  bool insert(T&& x)
+  { return m_tree.insert_unique(std::move(x)); }
+
+  /**
+   * @brief amortized O(1) when x goes right before hint.
+   */
+  iterator insert(iterator hint, const T& x)
+  { return iterator(m_tree.insert_unique(hint.node(), x)); }
+
+  iterator insert(iterator hint, T&& x)
+  { return iterator(m_tree.insert_unique(hint.node(), std::move(x))); }
+
+  template <typename... Args>
+  bool emplace(Args&&... args)
+  { return m_tree.emplace_unique(std::forward<Args>(args)...).second; }
+
+  template <typename... Args>
+  iterator emplace_hint(iterator hint, Args&&... args) {
+    return iterator(m_tree.emplace_hint_unique(hint.node(), 
+                                               std::forward<Args>(args)...));
+  }
+
   bool erase(const T& x)
   { return m_tree.erase(x) != 0; }
 
+  template <typename U>
+  iterator find(const U& x) const
+  { return iterator(m_tree.find(x)); }
+
+  /**
+   * @brief in-place union / intersection / difference in
+   * O(m log(n/m + 1)), see rbtree::set_union. An rvalue argument is
+   * consumed without copying.
+   */
+  void set_union(set&& x, ThreadPool* pool = nullptr)
+  { m_tree.set_union(std::move(x.m_tree), pool); }
+
+  void set_union(const set& x, ThreadPool* pool = nullptr)
+  { m_tree.set_union(x.m_tree, pool); }
+
+  void set_intersection(set&& x, ThreadPool* pool = nullptr)
+  { m_tree.set_intersection(std::move(x.m_tree), pool); }
+
+  void set_intersection(const set& x, ThreadPool* pool = nullptr)
+  { m_tree.set_intersection(x.m_tree, pool); }
+
+  void set_difference(set&& x, ThreadPool* pool = nullptr)
+  { m_tree.set_difference(std::move(x.m_tree), pool); }
+
+  void set_difference(const set& x, ThreadPool* pool = nullptr)
+  { m_tree.set_difference(x.m_tree, pool); }
+
+  /**
+   * @brief splice the elements of src not in this set over, no
+   * allocation or copy; the others stay in src.
+   */
+  void merge(set& src, ThreadPool* pool = nullptr)
+  { m_tree.merge_unique(src.m_tree, pool); }
+
+  using node_type = typename tree_type::node_type;
+  using insert_return_type = typename tree_type::insert_return_type;
+
+  node_type extract(iterator pos)
+  { return m_tree.extract(pos); }
+
+  template <typename U>
+  node_type extract(const U& x)
+  { return m_tree.extract(x); }
+
+  insert_return_type insert(node_type&& nh)
+  { return m_tree.insert_unique(std::move(nh)); }
+
+  template <typename U>
+  bool contains(const U& x) const
+  { return m_tree.contains(x); }
+
+  template <typename U>
+  size_t count(const U& x) const
+  { return m_tree.contains(x) ? 1 : 0; }
+
   bool empty() const 
   { return m_tree.empty(); }
 
@@ -844,25 +2153,129 @@ class set {
 
 };
 
-template <typename K, typename V>
+template <typename K, typename V, typename Layout=rb_plain_layout>
 class map {
  protected:
-  rbtree<std::pair<K, V>> m_tree;
+  using tree_type = rbtree<std::pair<K, V>, tiny_allocator<std::pair<K, V>>,
+                           rb_no_augment, Layout>;
+
+  tree_type m_tree;
 
  public:
   map() = default;
 
-  map(std::initializer_list<std::pair<K, V>> l) : m_tree() {
-    for (auto&& x : l)
-      m_tree.insert(x);
-  }
+  map(std::initializer_list<std::pair<K, V>> l) : map(l.begin(), l.end()) {}
+
+  /**
+   * @brief O(n) when the keys of [first, last) are strictly ascending,
+   * O(n log n) otherwise.
+   */
+  template <typename ForwardIt>
+  map(ForwardIt first, ForwardIt last) : m_tree()
+  { m_tree.assign_unique(first, last); }
+
+  using iterator = typename tree_type::iterator;
+  using const_iterator = typename tree_type::const_iterator;
+
+  iterator begin()
+  { return m_tree.begin(); }
+
+  iterator end()
+  { return m_tree.end(); }
+
+  const_iterator begin() const
+  { return m_tree.begin(); }
+
+  const_iterator end() const
+  { return m_tree.end(); }
 
   bool insert(const std::pair<K, V>& x)
   { return m_tree.insert_unique(x); }
 
+  bool insert(std::pair<K, V>&& x)
+  { return m_tree.insert_unique(std::move(x)); }
+
+  /**
+   * @brief amortized O(1) when x goes right before hint.
+   */
+  iterator insert(const_iterator hint, const std::pair<K, V>& x)
+  { return iterator(m_tree.insert_unique(hint.node(), x)); }
+
+  iterator insert(const_iterator hint, std::pair<K, V>&& x)
+  { return iterator(m_tree.insert_unique(hint.node(), std::move(x))); }
+
+  template <typename... Args>
+  bool emplace(Args&&... args)
+  { return m_tree.emplace_unique(std::forward<Args>(args)...).second; }
+
+  template <typename... Args>
+  iterator emplace_hint(const_iterator hint, Args&&... args) {
+    return iterator(m_tree.emplace_hint_unique(hint.node(), 
+                                               std::forward<Args>(args)...));
+  }
+
   bool erase(const std::pair<K, V>& x)
   { return m_tree.erase(x) != 0; }
 
+  template <typename U>
+  iterator find(const U& key)
+  { return iterator(m_tree.find(key)); }
+
+  template <typename U>
+  const_iterator find(const U& key) const
+  { return const_iterator(m_tree.find(key)); }
+
+  template <typename U>
+  bool contains(const U& key) const
+  { return m_tree.contains(key); }
+
+  /**
+   * @brief splice the entries of src whose keys are not in this map
+   * over, no allocation or copy; the others stay in src.
+   */
+  void merge(map& src, ThreadPool* pool = nullptr)
+  { m_tree.merge_unique(src.m_tree, pool); }
+
+  using node_type = typename tree_type::node_type;
+  using insert_return_type = typename tree_type::insert_return_type;
+
+  node_type extract(const_iterator pos)
+  { return m_tree.extract(pos); }
+
+  node_type extract(iterator pos)
+  { return m_tree.extract(pos); }
+
+  template <typename U>
+  node_type extract(const U& key)
+  { return m_tree.extract(key); }
+
+  insert_return_type insert(node_type&& nh)
+  { return m_tree.insert_unique(std::move(nh)); }
+
+  template <typename U>
+  size_t count(const U& key) const
+  { return m_tree.contains(key) ? 1 : 0; }
+
+  /**
+   * @brief insert {key, V(args...)} unless key is present, in which
+   * case args are not touched (so they may still be moved from later).
+   */
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+    auto res = m_tree.try_emplace_unique(key, std::piecewise_construct,
+      std::forward_as_tuple(key),
+      std::forward_as_tuple(std::forward<Args>(args)...));
+    return std::pair<iterator, bool>(iterator(res.first), res.second);
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+    auto res = m_tree.try_emplace_unique(key, std::piecewise_construct,
+      std::forward_as_tuple(std::move(key)),
+      std::forward_as_tuple(std::forward<Args>(args)...));
+    return std::pair<iterator, bool>(iterator(res.first), res.second);
+  }
+
   bool empty() const 
   { return m_tree.empty(); }
 
@@ -878,15 +2291,15 @@ class map {
   friend std::ostream& operator<<(std::ostream& os, const map& x)
   { return os << x.m_tree; }
 
-  V& operator[](const K& key) {
-    m_tree.insert_unique(std::pair<K, V>(key, V()));
-    rbnode<std::pair<K, V>>* lower = m_tree.lower_bound(key);
-    return lower->m_data.second;
-  }
+  V& operator[](const K& key)
+  { return try_emplace(key).first->second; }
+
+  V& operator[](K&& key)
+  { return try_emplace(std::move(key)).first->second; }
 
   const V& operator[](const K& key) const {
-    rbnode<std::pair<K, V>>* lower = m_tree.lower_bound(key);
-    if (lower->m_data.first != key) {
+    auto lower = m_tree.find(key);
+    if (lower == m_tree.end().node()) {
       std::ostringstream msg;
       msg << "KeyError: " << key;
       throw std::logic_error(msg.str());
@@ -896,3 +2309,91 @@ class map {
   }
 
 };
+
+/**
+ * @brief multimap from half-open intervals [lo, hi) to values, with
+ * overlap and stabbing queries that call back instead of allocating.
+ */
+template <typename K, typename V>
+class interval_map {
+ protected:
+  using interval_type = rb_interval<K>;
+  using value_type = std::pair<interval_type, V>;
+  using tree_type = rbtree<value_type, tiny_allocator<value_type>,
+                           rb_interval_augment<K>>;
+
+  tree_type m_tree;
+
+ public:
+  interval_map() = default;
+
+  interval_map(std::initializer_list<value_type> l) {
+    for (const value_type& x : l)
+      m_tree.insert_equal(x);
+  }
+
+  using iterator = typename tree_type::iterator;
+  using const_iterator = typename tree_type::const_iterator;
+
+  iterator begin()
+  { return m_tree.begin(); }
+
+  iterator end()
+  { return m_tree.end(); }
+
+  const_iterator begin() const
+  { return m_tree.begin(); }
+
+  const_iterator end() const
+  { return m_tree.end(); }
+
+  /**
+   * @brief equal intervals may be inserted more than once.
+   */
+  iterator insert(const K& lo, const K& hi, const V& value)
+  { return iterator(m_tree.emplace_equal(interval_type{lo, hi}, value)); }
+
+  iterator insert(const value_type& x)
+  { return iterator(m_tree.emplace_equal(x)); }
+
+  /**
+   * @brief remove every entry for [lo, hi).
+   * @return the number removed.
+   */
+  size_t erase(const K& lo, const K& hi) {
+    size_t n = 0;
+    while (!m_tree.extract(interval_type{lo, hi}).empty())
+      ++n;
+    return n;
+  }
+
+  /**
+   * @brief f(entry) for each entry overlapping [lo, hi), ascending.
+   */
+  template <typename F>
+  void overlap(const K& lo, const K& hi, F f) const
+  { m_tree.overlap(lo, hi, f); }
+
+  /**
+   * @brief f(entry) for each entry containing p, ascending.
+   */
+  template <typename F>
+  void stab(const K& p, F f) const
+  { m_tree.stab(p, f); }
+
+  bool empty() const
+  { return m_tree.empty(); }
+
+  size_t size() const
+  { return m_tree.size(); }
+
+  void clear()
+  { m_tree.clear(); }
+
+  void disp() const
+  { m_tree.disp(); }
+
+  friend std::ostream& operator<<(std::ostream& os, const interval_map& x)
+  { return os << x.m_tree; }
+
+};
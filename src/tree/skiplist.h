@@ -0,0 +1,694 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include "../components/mempool.h"
+#include "../components/epoch.h"
+
+#ifndef __PAIR_OSTREAM__
+#define __PAIR_OSTREAM__
+template <typename _Tp1, typename _Tp2>
+std::ostream& operator<<(std::ostream& os,
+  const std::pair<_Tp1, _Tp2>& pair) {
+  return os << '{' << pair.first << ", " << pair.second << '}';
+}
+#endif
+
+template <typename T>
+struct skipnode {
+  std::atomic<int> m_pending;  /* inserter and eraser still at work */
+  int m_height;
+  T m_data;
+  /* m_height links, the low bit marks the node as erased at a level */
+  std::atomic<uintptr_t> m_next[1];
+
+  static skipnode* ptr(uintptr_t w)
+  { return (skipnode*)(w & ~uintptr_t(1)); }
+
+  static bool marked(uintptr_t w)
+  { return w & 1; }
+
+  static size_t bytes(int height)
+  { return sizeof(skipnode) + (height - 1) * sizeof(std::atomic<uintptr_t>); }
+
+  skipnode* next() const
+  { return ptr(m_next[0].load(std::memory_order_acquire)); }
+
+  bool erased() const
+  { return marked(m_next[0].load(std::memory_order_acquire)); }
+};
+
+/**
+ * @brief lock-free ordered set of unique keys, safe to share between
+ * any number of threads.
+ *
+ * Towers are linked with CAS; an erase marks a node's links top down,
+ * the level 0 mark deciding which eraser wins, and whoever walks past
+ * a marked node unlinks it. Unlinked nodes go to epoch_domain and are
+ * freed once no thread can still reach them; nodes come from the
+ * tiny_mempool size classes.
+ *
+ * Iterators and the references they give are only safe while the
+ * caller holds an epoch_guard, or while nothing is erased.
+ */
+template <typename T>
+class skiplist {
+ public:
+  static constexpr int MAXLEVEL = 32;
+
+ protected:
+  using node = skipnode<T>;
+
+  node* m_head;
+  std::atomic<int64_t> m_size{0};
+
+ public:
+  template <typename V>
+  class skiplist_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = ptrdiff_t;
+    using pointer = V*;
+    using reference = V&;
+
+    skiplist_iterator() : m_node(nullptr) {}
+
+    explicit skiplist_iterator(skipnode<T>* x) : m_node(x) {}
+
+    template <typename U, typename = typename std::enable_if<
+      std::is_same<const U, V>::value>::type>
+    skiplist_iterator(const skiplist_iterator<U>& it) : m_node(it.node()) {}
+
+    reference operator*() const { return m_node->m_data; }
+
+    pointer operator->() const { return &m_node->m_data; }
+
+    // erased nodes are skipped, not necessarily unlinked yet.
+    skiplist_iterator& operator++() {
+      do {
+        m_node = m_node->next();
+      } while (m_node != nullptr && m_node->erased());
+      return *this;
+    }
+
+    skiplist_iterator operator++(int) {
+      skiplist_iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    skipnode<T>* node() const { return m_node; }
+
+    friend bool operator==(const skiplist_iterator& x,
+                           const skiplist_iterator& y)
+    { return x.m_node == y.m_node; }
+
+    friend bool operator!=(const skiplist_iterator& x,
+                           const skiplist_iterator& y)
+    { return x.m_node != y.m_node; }
+
+   private:
+    skipnode<T>* m_node;
+  };
+
+  using value_type = T;
+  using iterator = skiplist_iterator<T>;
+  using const_iterator = skiplist_iterator<const T>;
+
+ public:
+  skiplist() : m_head(allocate(MAXLEVEL)) {
+    m_head->m_height = MAXLEVEL;
+    for (int i = 0; i < MAXLEVEL; i++)
+      m_head->m_next[i].store(0, std::memory_order_relaxed);
+  }
+
+  skiplist(const skiplist&) = delete;
+
+  skiplist& operator=(const skiplist&) = delete;
+
+  /**
+   * @attention no other thread may use the list any more.
+   */
+  ~skiplist() {
+    node* x = m_head->next();
+    while (x != nullptr) {
+      node* next = x->next();
+      destroy_node(x);
+      x = next;
+    }
+    deallocate(m_head, MAXLEVEL);
+  }
+
+  /**
+   * @brief may be transiently off by the operations in flight.
+   */
+  size_t size() const {
+    int64_t n = m_size.load(std::memory_order_relaxed);
+    return n < 0 ? 0 : n;
+  }
+
+  bool empty() const {
+    epoch_guard guard;
+    return begin() == end();
+  }
+
+  iterator begin() {
+    iterator it(m_head);
+    return ++it;
+  }
+
+  iterator end()
+  { return iterator(); }
+
+  const_iterator begin() const
+  { return const_cast<skiplist*>(this)->begin(); }
+
+  const_iterator end() const
+  { return const_iterator(); }
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace_unique(Args&&... args) {
+    epoch_guard guard;
+    node* x = create_node(random_level(), std::forward<Args>(args)...);
+    auto res = __insert(x);
+    if (!res.second)
+      destroy_node(x);
+    return std::pair<iterator, bool>(iterator(res.first), res.second);
+  }
+
+  bool insert_unique(const T& x)
+  { return emplace_unique(x).second; }
+
+  bool insert_unique(T&& x)
+  { return emplace_unique(std::move(x)).second; }
+
+  /**
+   * @brief emplace T(args...) unless key is present, in which case
+   * args are not touched.
+   */
+  template <typename K, typename... Args>
+  std::pair<iterator, bool> try_emplace_unique(const K& key, Args&&... args) {
+    epoch_guard guard;
+    node* preds[MAXLEVEL];
+    node* succs[MAXLEVEL];
+    if (__find(key, preds, succs))
+      return std::pair<iterator, bool>(iterator(succs[0]), false);
+    node* x = create_node(random_level(), std::forward<Args>(args)...);
+    auto res = __insert(x);
+    if (!res.second)
+      destroy_node(x);
+    return std::pair<iterator, bool>(iterator(res.first), res.second);
+  }
+
+  template <typename K>
+  bool erase(const K& key) {
+    epoch_guard guard;
+    node* preds[MAXLEVEL];
+    node* succs[MAXLEVEL];
+    if (!__find(key, preds, succs))
+      return false;
+    node* x = succs[0];
+    for (int i = x->m_height - 1; i > 0; i--)
+      x->m_next[i].fetch_or(1);
+    uintptr_t w = x->m_next[0].load();
+    do {
+      if (node::marked(w))
+        return false;  // another eraser won.
+    } while (!x->m_next[0].compare_exchange_weak(w, w | 1));
+    m_size.fetch_sub(1, std::memory_order_relaxed);
+    if (x->m_pending.fetch_sub(1) == 1)
+      __reclaim(x);
+    return true;
+  }
+
+  /**
+   * @brief erase every element, concurrent inserts may survive.
+   */
+  void clear() {
+    epoch_guard guard;
+    for (auto it = begin(); it != end(); ++it)
+      erase(key_of(*it));
+  }
+
+  /**
+   * @brief wait-free: follows links without unlinking anything.
+   */
+  template <typename K>
+  iterator find(const K& key) {
+    epoch_guard guard;
+    node* x = __lookup(key);
+    return x != nullptr && !less(key, x->m_data) ? iterator(x) : end();
+  }
+
+  template <typename K>
+  const_iterator find(const K& key) const
+  { return const_cast<skiplist*>(this)->find(key); }
+
+  template <typename K>
+  iterator lower_bound(const K& key) {
+    epoch_guard guard;
+    return iterator(__lookup(key));
+  }
+
+  template <typename K>
+  const_iterator lower_bound(const K& key) const
+  { return const_cast<skiplist*>(this)->lower_bound(key); }
+
+  template <typename K>
+  bool contains(const K& key) const {
+    epoch_guard guard;
+    node* x = __lookup(key);
+    return x != nullptr && !less(key, x->m_data);
+  }
+
+  // sorted and no erased node left linked, with no writer running.
+  bool isvalid() const {
+    for (int i = 0; i < MAXLEVEL; i++) {
+      uintptr_t w = m_head->m_next[i].load();
+      node* prev = nullptr;
+      for (node* x = node::ptr(w); x != nullptr; x = node::ptr(w)) {
+        w = x->m_next[i].load();
+        if (node::marked(w) || i >= x->m_height
+            || (prev != nullptr && !less(prev->m_data, x->m_data)))
+          return false;
+        prev = x;
+      }
+    }
+    return true;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const skiplist& x) {
+    epoch_guard guard;
+    os << '{';
+    auto it = x.begin();
+    if (it != x.end()) {
+      os << *it;
+      for (++it; it != x.end(); ++it)
+        os << ", " << *it;
+    }
+    return os << '}';
+  }
+
+ protected:
+  /**
+   * @brief link x unless its key is present.
+   * @return the node holding the key, x when it was inserted.
+   */
+  std::pair<node*, bool> __insert(node* x) {
+    node* preds[MAXLEVEL];
+    node* succs[MAXLEVEL];
+    const auto& key = key_of(x->m_data);
+    while (true) {
+      if (__find(key, preds, succs))
+        return std::pair<node*, bool>(succs[0], false);
+      for (int i = 0; i < x->m_height; i++)
+        x->m_next[i].store((uintptr_t)succs[i], std::memory_order_relaxed);
+      uintptr_t succ = (uintptr_t)succs[0];
+      if (preds[0]->m_next[0].compare_exchange_strong(succ, (uintptr_t)x))
+        break;
+    }
+    m_size.fetch_add(1, std::memory_order_relaxed);
+    // x is in the set, the upper levels are only shortcuts.
+    for (int i = 1; i < x->m_height; i++) {
+      while (true) {
+        uintptr_t w = x->m_next[i].load();
+        if (node::marked(w))
+          goto done;
+        if (w != (uintptr_t)succs[i]
+            && !x->m_next[i].compare_exchange_strong(w, (uintptr_t)succs[i]))
+          goto done;  // only a mark changes it.
+        uintptr_t succ = (uintptr_t)succs[i];
+        if (preds[i]->m_next[i].compare_exchange_strong(succ, (uintptr_t)x))
+          break;
+        __find(key, preds, succs);
+        if (succs[0] != x)
+          goto done;  // erased meanwhile.
+      }
+    }
+  done:
+    if (x->m_pending.fetch_sub(1) == 1)
+      __reclaim(x);
+    return std::pair<node*, bool>(x, true);
+  }
+
+  /**
+   * @brief preds[i] / succs[i]: the last node before key and the
+   * first unerased node not less than key at level i, unlinking the
+   * erased ones met on the way.
+   * @return whether succs[0] holds key.
+   */
+  template <typename K>
+  bool __find(const K& key, node** preds, node** succs) {
+  retry:
+    node* pred = m_head;
+    for (int i = MAXLEVEL - 1; i >= 0; i--) {
+      node* curr = node::ptr(pred->m_next[i].load(std::memory_order_acquire));
+      while (curr != nullptr) {
+        uintptr_t w = curr->m_next[i].load(std::memory_order_acquire);
+        if (node::marked(w)) {
+          uintptr_t expected = (uintptr_t)curr;
+          if (!pred->m_next[i].compare_exchange_strong(expected,
+                                                       (uintptr_t)node::ptr(w)))
+            goto retry;
+          curr = node::ptr(w);
+        } else if (less(curr->m_data, key)) {
+          pred = curr;
+          curr = node::ptr(w);
+        } else {
+          break;
+        }
+      }
+      preds[i] = pred;
+      succs[i] = curr;
+    }
+    return succs[0] != nullptr && !less(key, succs[0]->m_data);
+  }
+
+  /**
+   * @brief unlink the erased node x from every level it still sits on:
+   * it can hide behind nodes of the same key, so the whole run of
+   * equal keys is walked.
+   */
+  void __unlink(node* x) {
+    const auto& key = key_of(x->m_data);
+  retry:
+    node* pred = m_head;
+    for (int i = MAXLEVEL - 1; i >= 0; i--) {
+      node* curr = node::ptr(pred->m_next[i].load(std::memory_order_acquire));
+      node* p = pred;
+      while (curr != nullptr) {
+        uintptr_t w = curr->m_next[i].load(std::memory_order_acquire);
+        if (node::marked(w)) {
+          uintptr_t expected = (uintptr_t)curr;
+          if (!p->m_next[i].compare_exchange_strong(expected,
+                                                    (uintptr_t)node::ptr(w)))
+            goto retry;
+          curr = node::ptr(w);
+        } else if (less(curr->m_data, key)) {
+          pred = p = curr;
+          curr = node::ptr(w);
+        } else if (!less(key, curr->m_data)) {
+          p = curr;
+          curr = node::ptr(w);
+        } else {
+          break;
+        }
+      }
+    }
+  }
+
+  // the inserter and the eraser are both done with x.
+  void __reclaim(node* x) {
+    __unlink(x);
+    epoch_domain::instance().retire(x, &skiplist::free_node);
+  }
+
+  // first unerased node not less than key.
+  template <typename K>
+  node* __lookup(const K& key) const {
+    node* pred = m_head;
+    node* curr = nullptr;
+    for (int i = MAXLEVEL - 1; i >= 0; i--) {
+      curr = node::ptr(pred->m_next[i].load(std::memory_order_acquire));
+      while (curr != nullptr) {
+        uintptr_t w = curr->m_next[i].load(std::memory_order_acquire);
+        if (!node::marked(w) && !less(curr->m_data, key))
+          break;
+        if (!node::marked(w))
+          pred = curr;
+        curr = node::ptr(w);
+      }
+    }
+    return curr;
+  }
+
+  // level i + 1 with probability 1 / 4^i.
+  static int random_level() {
+    static thread_local uint64_t seed =
+      0x9E3779B97F4A7C15ull * (uintptr_t)&seed | 1;
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    int level = __builtin_ctzll(seed | (1ull << 62)) / 2 + 1;
+    return level < MAXLEVEL ? level : MAXLEVEL;
+  }
+
+  static node* allocate(int height)
+  { return (node*)tiny_mempool::instance().alloc(node::bytes(height)); }
+
+  static void deallocate(node* x, int height)
+  { tiny_mempool::instance().delloc(x, node::bytes(height)); }
+
+  template <typename... Args>
+  static node* create_node(int height, Args&&... args) {
+    node* x = allocate(height);
+    try {
+      new (&x->m_data) T(std::forward<Args>(args)...);
+    } catch (...) {
+      deallocate(x, height);
+      throw;
+    }
+    x->m_height = height;
+    new (&x->m_pending) std::atomic<int>(2);
+    return x;
+  }
+
+  static void destroy_node(node* x) {
+    (&x->m_data)->~T();
+    deallocate(x, x->m_height);
+  }
+
+  static void free_node(void* p)
+  { destroy_node((node*)p); }
+
+  static const T& key_of(const T& x)
+  { return x; }
+
+  template <typename _Tp1, typename _Tp2>
+  static const _Tp1& key_of(const std::pair<_Tp1, _Tp2>& x)
+  { return x.first; }
+
+  template <typename _Tp>
+  static bool less(const _Tp& x, const _Tp& y)
+  { return x < y; }
+
+  template <typename _Tp1, typename _Tp2>
+  static bool less(const std::pair<_Tp1, _Tp2>& x,
+                   const std::pair<_Tp1, _Tp2>& y) {
+    return x.first < y.first;
+  }
+
+  template <typename _Tp1, typename _Tp2, typename _Up>
+  static bool less(const std::pair<_Tp1, _Tp2>& x, const _Up& y) {
+    return x.first < y;
+  }
+
+  template <typename _Up, typename _Tp1, typename _Tp2>
+  static bool less(const _Up& x, const std::pair<_Tp1, _Tp2>& y) {
+    return x < y.first;
+  }
+
+  template <typename _Up, typename _Vp>
+  static bool less(const _Up& x, const _Vp& y)
+  { return x < y; }
+};
+
+template <typename T>
+constexpr int skiplist<T>::MAXLEVEL;
+
+/**
+ * @brief set safe to share between threads without locks, with the
+ * interface of set. See skiplist for when iterators may be used.
+ */
+template <typename T>
+class skiplist_set {
+ protected:
+  using tree_type = skiplist<T>;
+
+  tree_type m_tree;
+
+ public:
+  skiplist_set() = default;
+
+  skiplist_set(std::initializer_list<T> l) {
+    for (const T& x : l)
+      insert(x);
+  }
+
+  using iterator = typename tree_type::const_iterator;
+  using const_iterator = iterator;
+
+  iterator begin() const
+  { return m_tree.begin(); }
+
+  iterator end() const
+  { return m_tree.end(); }
+
+  bool insert(const T& x)
+  { return m_tree.insert_unique(x); }
+
+  bool insert(T&& x)
+  { return m_tree.insert_unique(std::move(x)); }
+
+  template <typename... Args>
+  bool emplace(Args&&... args)
+  { return m_tree.emplace_unique(std::forward<Args>(args)...).second; }
+
+  bool erase(const T& x)
+  { return m_tree.erase(x); }
+
+  template <typename U>
+  iterator find(const U& x) const
+  { return m_tree.find(x); }
+
+  template <typename U>
+  iterator lower_bound(const U& x) const
+  { return m_tree.lower_bound(x); }
+
+  template <typename U>
+  bool contains(const U& x) const
+  { return m_tree.contains(x); }
+
+  template <typename U>
+  size_t count(const U& x) const
+  { return m_tree.contains(x) ? 1 : 0; }
+
+  bool empty() const
+  { return m_tree.empty(); }
+
+  size_t size() const
+  { return m_tree.size(); }
+
+  void clear()
+  { m_tree.clear(); }
+
+  bool isvalid() const
+  { return m_tree.isvalid(); }
+
+  friend std::ostream& operator<<(std::ostream& os, const skiplist_set& x)
+  { return os << x.m_tree; }
+};
+
+/**
+ * @brief map safe to share between threads without locks, with the
+ * interface of map. The links are lock-free, the values are not:
+ * writing a value another thread may read needs an atomic V or a lock
+ * of its own.
+ */
+template <typename K, typename V>
+class skiplist_map {
+ protected:
+  using tree_type = skiplist<std::pair<K, V>>;
+
+  tree_type m_tree;
+
+ public:
+  skiplist_map() = default;
+
+  skiplist_map(std::initializer_list<std::pair<K, V>> l) {
+    for (const auto& x : l)
+      insert(x);
+  }
+
+  using iterator = typename tree_type::iterator;
+  using const_iterator = typename tree_type::const_iterator;
+
+  iterator begin()
+  { return m_tree.begin(); }
+
+  iterator end()
+  { return m_tree.end(); }
+
+  const_iterator begin() const
+  { return m_tree.begin(); }
+
+  const_iterator end() const
+  { return m_tree.end(); }
+
+  bool insert(const std::pair<K, V>& x)
+  { return m_tree.insert_unique(x); }
+
+  bool insert(std::pair<K, V>&& x)
+  { return m_tree.insert_unique(std::move(x)); }
+
+  template <typename... Args>
+  bool emplace(Args&&... args)
+  { return m_tree.emplace_unique(std::forward<Args>(args)...).second; }
+
+  /**
+   * @brief insert {key, V(args...)} unless key is present, in which
+   * case args are not touched.
+   */
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+    return m_tree.try_emplace_unique(key, std::piecewise_construct,
+      std::forward_as_tuple(key),
+      std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  bool erase(const K& key)
+  { return m_tree.erase(key); }
+
+  template <typename U>
+  iterator find(const U& key)
+  { return m_tree.find(key); }
+
+  template <typename U>
+  const_iterator find(const U& key) const
+  { return m_tree.find(key); }
+
+  template <typename U>
+  iterator lower_bound(const U& key)
+  { return m_tree.lower_bound(key); }
+
+  template <typename U>
+  const_iterator lower_bound(const U& key) const
+  { return m_tree.lower_bound(key); }
+
+  template <typename U>
+  bool contains(const U& key) const
+  { return m_tree.contains(key); }
+
+  template <typename U>
+  size_t count(const U& key) const
+  { return m_tree.contains(key) ? 1 : 0; }
+
+  bool empty() const
+  { return m_tree.empty(); }
+
+  size_t size() const
+  { return m_tree.size(); }
+
+  void clear()
+  { m_tree.clear(); }
+
+  bool isvalid() const
+  { return m_tree.isvalid(); }
+
+  friend std::ostream& operator<<(std::ostream& os, const skiplist_map& x)
+  { return os << x.m_tree; }
+
+  V& operator[](const K& key)
+  { return try_emplace(key).first->second; }
+
+  V& at(const K& key) {
+    auto it = find(key);
+    if (it == end())
+      throw std::out_of_range("KeyError");
+    return it->second;
+  }
+
+  const V& at(const K& key) const {
+    auto it = find(key);
+    if (it == end())
+      throw std::out_of_range("KeyError");
+    return it->second;
+  }
+};
@@ -0,0 +1,495 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "rbtree.h"
+
+/**
+ * Flat snapshot files of set / map / rbtree, opened read-only with mmap
+ * by mapped_set / mapped_map and searched in place.
+ *
+ * Layout, all in native byte order:
+ *   [0, 64)   snapshot_header
+ *   [64, ..)  keys[0 .. n], keys[0] unused, keys[1 .. n] in Eytzinger
+ *             order: the children of keys[k] are keys[2k] and keys[2k+1]
+ *   [.., ..)  values[0 .. n] in the same order, maps only, 64 aligned
+ *
+ * A search walks down from keys[1]; the 64 aligned base keeps the
+ * descendants four levels down (int keys) on one cache line, which
+ * is prefetched while the levels above are compared.
+ */
+
+struct snapshot_header {
+  static constexpr char MAGIC[8] = {'R', 'B', 'S', 'N', 'A', 'P', '\0', '\0'};
+  static constexpr uint32_t VERSION = 1;
+
+  char m_magic[8];
+  uint32_t m_version;
+  uint32_t m_key_size;
+  uint32_t m_value_size;  /* 0 for sets */
+  uint32_t m_reserved;
+  uint64_t m_count;
+  uint64_t m_keys;        /* file offset of keys[0] */
+  uint64_t m_values;      /* file offset of values[0], 0 for sets */
+  uint64_t m_bytes;       /* file size */
+};
+
+constexpr char snapshot_header::MAGIC[8];
+constexpr uint32_t snapshot_header::VERSION;
+
+static_assert(sizeof(snapshot_header) <= 64, "the header has 64 bytes");
+
+template <typename T>
+struct snapshot_traits {
+  using key_type = T;
+  using mapped_type = void;
+  static constexpr size_t VALUESIZE = 0;
+
+  static const T& key(const T& x)
+  { return x; }
+};
+
+template <typename K, typename V>
+struct snapshot_traits<std::pair<K, V>> {
+  using key_type = K;
+  using mapped_type = V;
+  static constexpr size_t VALUESIZE = sizeof(V);
+
+  static const K& key(const std::pair<K, V>& x)
+  { return x.first; }
+
+  static const V& value(const std::pair<K, V>& x)
+  { return x.second; }
+};
+
+/**
+ * @brief implicit tree walks over the 1-based Eytzinger order of n keys.
+ */
+struct eytzinger {
+  // the smallest key.
+  static size_t first(size_t n) {
+    if (n == 0)
+      return 0;
+    size_t k = 1;
+    while (2 * k <= n)
+      k *= 2;
+    return k;
+  }
+
+  // in-order successor of k, 0 after the largest key.
+  static size_t next(size_t k, size_t n) {
+    if (2 * k + 1 <= n) {
+      k = 2 * k + 1;
+      while (2 * k <= n)
+        k *= 2;
+      return k;
+    }
+    return k >> __builtin_ffsll(~k);
+  }
+
+  /**
+   * @return the index of the first key not less than x, 0 if none.
+   * Branch free: every step goes down one level, the final shift
+   * climbs back past the right turns taken below the answer.
+   */
+  template <typename K, typename U>
+  static size_t lower_bound(const K* keys, size_t n, const U& x) {
+    constexpr size_t AHEAD = 64 / sizeof(K) > 1 ? 64 / sizeof(K) : 1;
+    size_t k = 1;
+    while (k <= n) {
+      __builtin_prefetch((const char*)keys + k * AHEAD * sizeof(K));
+      k = 2 * k + (keys[k] < x);
+    }
+    return k >> __builtin_ffsll(~k);
+  }
+};
+
+template <typename T>
+void __save_value(char*, size_t, const T&, std::false_type) {}
+
+template <typename T>
+void __save_value(char* values, size_t k, const T& x, std::true_type) {
+  using V = typename snapshot_traits<T>::mapped_type;
+  static_assert(std::is_trivially_copyable<V>::value,
+                "snapshot values must be trivially copyable");
+  memcpy(values + k * sizeof(V), &snapshot_traits<T>::value(x), sizeof(V));
+}
+
+/**
+ * @brief write the n elements of the ascending range at first to
+ * path + ".tmp", sync it and rename it over path.
+ * @return false when the file could not be written, path is then
+ * left untouched.
+ */
+template <typename T, typename It>
+bool save_snapshot(const char* path, It first, size_t n) {
+  using traits = snapshot_traits<T>;
+  using K = typename traits::key_type;
+  static_assert(std::is_trivially_copyable<K>::value,
+                "snapshot keys must be trivially copyable");
+  snapshot_header h;
+  memcpy(h.m_magic, snapshot_header::MAGIC, sizeof(h.m_magic));
+  h.m_version = snapshot_header::VERSION;
+  h.m_key_size = sizeof(K);
+  h.m_value_size = traits::VALUESIZE;
+  h.m_reserved = 0;
+  h.m_count = n;
+  h.m_keys = 64;
+  uint64_t end = h.m_keys + (n + 1) * sizeof(K);
+  h.m_values = 0;
+  if (traits::VALUESIZE != 0) {
+    h.m_values = (end + 63) & ~uint64_t(63);
+    end = h.m_values + (n + 1) * traits::VALUESIZE;
+  }
+  h.m_bytes = end;
+
+  // readers keep the old file until the complete new one is renamed
+  // over it; a crash or full disk leaves only the .tmp file behind.
+  std::string tmp = std::string(path) + ".tmp";
+  int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+  // the blocks are reserved up front, a store into a hole of a full
+  // file system would raise SIGBUS.
+  char* base = (char*)MAP_FAILED;
+  if (posix_fallocate(fd, 0, h.m_bytes) == 0)
+    base = (char*)mmap(nullptr, h.m_bytes, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    ::close(fd);
+    ::unlink(tmp.c_str());
+    return false;
+  }
+  memcpy(base, &h, sizeof(h));
+  K* keys = (K*)(base + h.m_keys);
+  // the range is visited in order, the file in Eytzinger order.
+  for (size_t k = eytzinger::first(n); k != 0; k = eytzinger::next(k, n)) {
+    memcpy(keys + k, &traits::key(*first), sizeof(K));
+    __save_value<T>(base + h.m_values, k, *first,
+                    std::integral_constant<bool, traits::VALUESIZE != 0>());
+    ++first;
+  }
+  bool ok = msync(base, h.m_bytes, MS_SYNC) == 0;
+  munmap(base, h.m_bytes);
+  ok = ok && fsync(fd) == 0;
+  ok = ::close(fd) == 0 && ok;
+  ok = ok && ::rename(tmp.c_str(), path) == 0;
+  if (!ok)
+    ::unlink(tmp.c_str());
+  return ok;
+}
+
+template <typename T, typename Alloc, typename Augment, typename Layout>
+bool save_snapshot(const char* path,
+                   const rbtree<T, Alloc, Augment, Layout>& tree)
+{ return save_snapshot<T>(path, tree.begin(), tree.size()); }
+
+template <typename K, typename Layout>
+bool save_snapshot(const char* path, const set<K, Layout>& s)
+{ return save_snapshot<K>(path, s.begin(), s.size()); }
+
+template <typename K, typename V, typename Layout>
+bool save_snapshot(const char* path, const map<K, V, Layout>& m)
+{ return save_snapshot<std::pair<K, V>>(path, m.begin(), m.size()); }
+
+/**
+ * @brief read-only mapping of a snapshot file, shared by mapped_set
+ * and mapped_map. Opening checks the header and maps the file, no
+ * page is read until a search touches it.
+ */
+class mapped_snapshot {
+ protected:
+  const char* m_base = nullptr;
+  size_t m_bytes = 0;
+  size_t m_count = 0;
+  const void* m_keys = nullptr;
+  const void* m_values = nullptr;
+
+  mapped_snapshot() = default;
+
+  mapped_snapshot(mapped_snapshot&& x) noexcept
+  { swap(x); }
+
+  mapped_snapshot& operator=(mapped_snapshot&& x) noexcept {
+    mapped_snapshot tmp(std::move(x));
+    swap(tmp);
+    return *this;
+  }
+
+  ~mapped_snapshot()
+  { close(); }
+
+  void swap(mapped_snapshot& x) noexcept {
+    std::swap(m_base, x.m_base);
+    std::swap(m_bytes, x.m_bytes);
+    std::swap(m_count, x.m_count);
+    std::swap(m_keys, x.m_keys);
+    std::swap(m_values, x.m_values);
+  }
+
+  bool __open(const char* path, size_t key_size, size_t value_size) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(snapshot_header)) {
+      ::close(fd);
+      return false;
+    }
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+      return false;
+    const snapshot_header& h = *(const snapshot_header*)p;
+    uint64_t n = h.m_count;
+    bool valid = memcmp(h.m_magic, snapshot_header::MAGIC, 8) == 0
+      && h.m_version == snapshot_header::VERSION
+      && h.m_key_size == key_size && h.m_value_size == value_size
+      && h.m_bytes == (uint64_t)st.st_size
+      && h.m_keys % 64 == 0 && h.m_values % 64 == 0
+      && n < h.m_bytes
+      && h.m_keys + (n + 1) * key_size <= h.m_bytes
+      && (value_size == 0
+          || h.m_values + (n + 1) * value_size <= h.m_bytes);
+    if (!valid) {
+      munmap(p, st.st_size);
+      return false;
+    }
+    m_base = (const char*)p;
+    m_bytes = st.st_size;
+    m_count = n;
+    m_keys = m_base + h.m_keys;
+    m_values = value_size == 0 ? nullptr : m_base + h.m_values;
+    return true;
+  }
+
+ public:
+  void close() {
+    if (m_base != nullptr)
+      munmap((void*)m_base, m_bytes);
+    m_base = nullptr;
+    m_bytes = m_count = 0;
+    m_keys = m_values = nullptr;
+  }
+
+  bool is_open() const
+  { return m_base != nullptr; }
+
+  size_t size() const
+  { return m_count; }
+
+  bool empty() const
+  { return m_count == 0; }
+};
+
+/**
+ * @brief read-only set answered from a mapped snapshot, see
+ * save_snapshot. Iterators and references live as long as the mapping.
+ */
+template <typename K>
+class mapped_set : public mapped_snapshot {
+  static_assert(std::is_trivially_copyable<K>::value,
+                "snapshot keys must be trivially copyable");
+
+ public:
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = K;
+    using difference_type = ptrdiff_t;
+    using pointer = const K*;
+    using reference = const K&;
+
+    const_iterator() : m_keys(nullptr), m_count(0), m_index(0) {}
+
+    const_iterator(const K* keys, size_t n, size_t k)
+      : m_keys(keys), m_count(n), m_index(k) {}
+
+    reference operator*() const { return m_keys[m_index]; }
+
+    pointer operator->() const { return m_keys + m_index; }
+
+    const_iterator& operator++() {
+      m_index = eytzinger::next(m_index, m_count);
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    size_t index() const { return m_index; }
+
+    friend bool operator==(const const_iterator& x, const const_iterator& y)
+    { return x.m_index == y.m_index; }
+
+    friend bool operator!=(const const_iterator& x, const const_iterator& y)
+    { return x.m_index != y.m_index; }
+
+   private:
+    const K* m_keys;
+    size_t m_count;
+    size_t m_index;  /* 0 at the end */
+  };
+
+  using iterator = const_iterator;
+
+  mapped_set() = default;
+
+  /**
+   * @return false, leaving the set closed, when path is missing or is
+   * not a set snapshot of K.
+   */
+  bool open(const char* path)
+  { return __open(path, sizeof(K), 0); }
+
+  const_iterator begin() const
+  { return const_iterator(keys(), m_count, eytzinger::first(m_count)); }
+
+  const_iterator end() const
+  { return const_iterator(keys(), m_count, 0); }
+
+  template <typename U>
+  const_iterator lower_bound(const U& x) const
+  { return const_iterator(keys(), m_count,
+                          eytzinger::lower_bound(keys(), m_count, x)); }
+
+  template <typename U>
+  const_iterator find(const U& x) const {
+    auto it = lower_bound(x);
+    return it != end() && !(x < *it) ? it : end();
+  }
+
+  template <typename U>
+  bool contains(const U& x) const
+  { return find(x) != end(); }
+
+  template <typename U>
+  size_t count(const U& x) const
+  { return contains(x) ? 1 : 0; }
+
+ protected:
+  const K* keys() const
+  { return (const K*)m_keys; }
+};
+
+/**
+ * @brief read-only map answered from a mapped snapshot, see
+ * save_snapshot. Keys and values sit in separate columns, so
+ * iterators give pairs of references into the mapping.
+ */
+template <typename K, typename V>
+class mapped_map : public mapped_snapshot {
+  static_assert(std::is_trivially_copyable<K>::value
+                && std::is_trivially_copyable<V>::value,
+                "snapshot keys and values must be trivially copyable");
+
+ public:
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<K, V>;
+    using difference_type = ptrdiff_t;
+    using reference = std::pair<const K&, const V&>;
+
+    const_iterator() : m_map(nullptr), m_index(0) {}
+
+    const_iterator(const mapped_map* map, size_t k)
+      : m_map(map), m_index(k) {}
+
+    reference operator*() const
+    { return reference(key(), value()); }
+
+    const K& key() const { return m_map->keys()[m_index]; }
+
+    const V& value() const { return m_map->values()[m_index]; }
+
+    const_iterator& operator++() {
+      m_index = eytzinger::next(m_index, m_map->m_count);
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    size_t index() const { return m_index; }
+
+    friend bool operator==(const const_iterator& x, const const_iterator& y)
+    { return x.m_index == y.m_index; }
+
+    friend bool operator!=(const const_iterator& x, const const_iterator& y)
+    { return x.m_index != y.m_index; }
+
+   private:
+    const mapped_map* m_map;
+    size_t m_index;  /* 0 at the end */
+  };
+
+  using iterator = const_iterator;
+
+  mapped_map() = default;
+
+  /**
+   * @return false, leaving the map closed, when path is missing or is
+   * not a map snapshot of K to V.
+   */
+  bool open(const char* path)
+  { return __open(path, sizeof(K), sizeof(V)); }
+
+  const_iterator begin() const
+  { return const_iterator(this, eytzinger::first(m_count)); }
+
+  const_iterator end() const
+  { return const_iterator(this, 0); }
+
+  template <typename U>
+  const_iterator lower_bound(const U& key) const
+  { return const_iterator(this, eytzinger::lower_bound(keys(), m_count, key)); }
+
+  template <typename U>
+  const_iterator find(const U& key) const {
+    size_t k = eytzinger::lower_bound(keys(), m_count, key);
+    return const_iterator(this, k != 0 && !(key < keys()[k]) ? k : 0);
+  }
+
+  template <typename U>
+  bool contains(const U& key) const
+  { return find(key) != end(); }
+
+  template <typename U>
+  size_t count(const U& key) const
+  { return contains(key) ? 1 : 0; }
+
+  const V& at(const K& key) const {
+    auto it = find(key);
+    if (it == end())
+      throw std::out_of_range("KeyError");
+    return it.value();
+  }
+
+  const V& operator[](const K& key) const
+  { return at(key); }
+
+ protected:
+  const K* keys() const
+  { return (const K*)m_keys; }
+
+  const V* values() const
+  { return (const V*)m_values; }
+};